@@ -32,6 +32,7 @@
 
 #if (defined __AVR__)
 # include <avr/io.h>
+# include <avr/pgmspace.h>
 // this is only for producing debug output via serial interface!
 # ifdef USE_N4TXI_UART
 #  include "Serial.h"
@@ -42,427 +43,1665 @@
 
 #include "GPS.h"
 
+#if !(defined __AVR__)
+# include "GPSIndex.h"
+# define PROGMEM
+# define pgm_read_byte(_addr)  (*(const unsigned char *)(_addr))
+
+/** Order the memory accesses before and after it (see GpsSnapshot_t). */
+# define GpsBarrier()  __sync_synchronize()
+#endif /* __AVR__ */
+
+
+GpsSnapshot_t gGpsSnapshot;                     // externally visible variables
+
+char gAltitudeFeet[7];				// Altitude (feet) in FFFFFF format
+GpsCacheStats_t gAltitudeFeetCache;
+
+#ifndef APRS
+char gLocator[7];				// Maidenhead locator
+GpsCacheStats_t gLocatorCache;
+#endif /* APRS */
+
+static GpsParser_t gGpsParser = {		// Default context of GpsMsg*()
+  .fSentenceType = kNONE,
+#ifndef APRS
+  .fSpeed        = -1,
+#endif /* APRS */
+};
+
+static void GpsSentencePending(GpsParser_t *parser);
+
+/* ------------------------------------------------------------------------- */
+
+void GpsParserInit(GpsParser_t *parser)
+/*
+ * ABSTRACT:	Initialize some of the fields in case we transmit before the GPS
+ *				has lock and sends us valid data.
+ *
+ * INPUT:	parser		Parser context to initialize
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  GpsData_t *data = &parser->fData;
+
+  memset( data, sizeof(*data), ' ');  // blanks everywhere
+
+  // write terminating 0 to finish C strings properly
+
+  data->fTime[sizeof(data->fTime) - 1]             =
+#ifndef APRS
+  data->fDate[sizeof(data->fDate) - 1]             =
+#endif /* APRS */
+  data->fLatitude[sizeof(data->fLatitude) - 1]     =
+  data->fLongitude[sizeof(data->fLongitude) - 1]   =
+  data->fAltitude[sizeof(data->fAltitude) - 1]     =
+  data->fSpeed[sizeof(data->fSpeed) - 1]           =
+  data->fCourse[sizeof(data->fCourse) - 1]         =
+#ifndef APRS
+  data->fHDOP[sizeof(data->fHDOP) - 1]             =
+#endif /* APRS */
+  data->fSatellites[sizeof(data->fSatellites) - 1] = 0;
+
+  // special initialisations ...
+
+  data->fSpeed[0]      = data->fSpeed[1]
+                       = data->fSpeed[2]    = '0';
+  data->fCourse[0]     = data->fCourse[1]
+                       = data->fCourse[2]   = '0';
+  data->fAltitude[0]   = data->fAltitude[1] = '0';
+  data->fAltitude[2]   = '.';
+
+  data->fNorthSouth[0] = 'N';
+  data->fEastWest[0]   = 'E';
+
+  memset( &data->fFix, 0, sizeof(data->fFix) );
+
+  parser->fChecksumState = kChecksumIdle;	// nothing to drop yet
+  parser->fSentences = 0;
+  parser->fRejected = 0;
+  parser->fChecksumErrors = 0;
+  parser->fChanged = kFieldAll;			// nothing reported yet
+
+  parser->fEpoch = 0;				// no epoch yet, nothing learned
+  parser->fEpochSeen = 0;
+  parser->fEpochType = parser->fEpochEnd = kNONE;
+  parser->fEpochFlags = 0;
+
+  GpsParserReset( parser );
+
+#ifndef APRS
+  parser->fSpeed = -1;
+#endif /* APRS */
+
+} // End GpsParserInit
+
+/* ------------------------------------------------------------------------- */
+
+static void GpsSentenceDrop(GpsParser_t *parser)
+/*
+ * ABSTRACT:	Drop the sentence currently decoded (if any), its staged
+ *		fields are never stored.
+ *
+ * INPUT:	parser		Parser context of the stream
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  if ( parser->fChecksumState == kChecksumIdle )
+    return;
+
+  parser->fRejected += 1;
+  parser->fChecksumState = kChecksumIdle;
+
+} // End GpsSentenceDrop(GpsParser_t *parser)
+
+/* ------------------------------------------------------------------------- */
+
+void GpsParserReset(GpsParser_t *parser)
+/*
+ * ABSTRACT:	Abort decoding of the current sentence, nothing more is
+ *				decoded up to the next '$'.
+ *
+ * INPUT:	parser		Parser context to reset
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  GpsSentencePending( parser );			// verified already
+  GpsSentenceDrop( parser );
+
+  parser->fCommas = 25;			       	// Set to an outrageous value
+  parser->fIndex = 0;
+  parser->fSentenceType = kNONE;	       	// Clear local parse variable
+  parser->fStaged = 0;
+  GpsDataClear( &parser->fData );
+
+} // End GpsParserReset
+
+/* ------------------------------------------------------------------------- */
+
+void GpsParserPrepare(GpsParser_t *parser, GpsData_t *data)
+ {
+  GpsParserUpdate( parser, data, kFieldAll );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void GpsParserUpdate(GpsParser_t *parser, GpsData_t *data, uint16_t stale)
+/*
+ * ABSTRACT:	Call this function right before sending a position report for two
+ *				reasons. This copies all the temp strings into transmit strings so
+ *				they are not modified by the GPS receive handler.  Altitude is also
+ *				converted into feet from meters.
+ *
+ *		The data is the one of the last completed epoch: if that
+ *		was ended by the first sentence of the next one, this is
+ *		stored afterwards.
+ *
+ *		Only the strings of the fields changed since the last fix
+ *		(or in 'stale') are copied, the others are still in 'data'.
+ *
+ * INPUT:	parser		Parser context holding the decoded data
+ *		data		An earlier fix of the parser
+ *		stale		Fields to be copied anyway, kFieldAll if
+ *				'data' holds something else
+ * OUTPUT:	data		Destination of the stable data
+ * RETURN:	None
+ */
+ {
+  GpsData_t *temp = &parser->fData;
+  uint16_t   changed = parser->fChanged;
+
+#ifndef APRS
+  if ( changed & kFieldSpeed )                              // course is 0 if speed is 0
+    changed |= kFieldCourse;
+#endif /* APRS */
+
+  const uint16_t copy = changed | stale;
+
+  GpsDataClear( data );
+
+  if ( copy & kFieldTime )
+    strcpy( data->fTime, temp->fTime );                     // latest Time
+
+#ifndef APRS
+  if ( copy & kFieldDate )
+    strcpy( data->fDate, temp->fDate );                     // latest Date
+#endif /* APRS */
+
+  if ( copy & kFieldLatitude ) {
+    strcpy( data->fLatitude, temp->fLatitude );             // latest Latitude
+    if ( data->fLatitude[0] == '0' )                        // remove leading '0' in degrees field
+      data->fLatitude[0] = ' ';
+    data->fNorthSouth[0] = temp->fNorthSouth[0];
+  }
+
+  if ( copy & kFieldLongitude ) {
+    strcpy( data->fLongitude, temp->fLongitude );           // latest Longitude
+    for ( uint8_t i=0; i<2; i++ ) {                         // remove leading '0' in degrees field
+      if ( data->fLongitude[i] == '0' )
+        data->fLongitude[i] = ' ';
+      else
+        break;
+    }
+    data->fEastWest[0] = temp->fEastWest[0];
+  }
+
+  if ( copy & kFieldAltitude )
+    strcpy( data->fAltitude, temp->fAltitude );             // latest Altitude
+
+#ifndef APRS
+  for ( uint8_t i=0; i<sizeof(temp->fSpeed); i++ )          // skip fractional value
+    if (  temp->fSpeed[i] == '.' ) {
+      temp->fSpeed[i] = 0;
+      break;
+    }
+
+  int16_t speed = temp->fFix.fSpeed / 10;                   // km/h
+
+  // check gradient, it foo high, use old value
+  if ( parser->fSpeed != -1 && abs( parser->fSpeed - speed ) > 50 ) {
+    speed = parser->fSpeed;
+    temp->fFix.fSpeed = speed * 10;
+    itoa( speed, temp->fSpeed, 10 );
+  }
+
+  parser->fSpeed = speed;
+
+  // course undefined if speed == 0 --> set to 0
+  if ( parser->fSpeed == 0 ) {
+    temp->fFix.fCourse = 0;
+    itoa( 0, temp->fCourse, 10 );
+  }
+#endif /* APRS */
+  if ( copy & kFieldSpeed )
+    strcpy( data->fSpeed, temp->fSpeed );                   // latest Speed
+
+#ifndef APRS
+  for ( uint8_t i=0; i<sizeof(temp->fCourse); i++ )         // skip fractional value
+    if (  temp->fCourse[i] == '.' ) {
+      temp->fCourse[i] = 0;
+      break;
+    }
+#endif /* APRS */
+  if ( copy & kFieldCourse )
+    strcpy( data->fCourse, temp->fCourse );                 // latest Course
+
+  if ( copy & kFieldSatellites )
+    strcpy( data->fSatellites, temp->fSatellites );         // latest Satellites
+
+#ifndef APRS
+  if ( copy & kFieldHDOP )
+    strcpy( data->fHDOP, temp->fHDOP );                     // latest HDOP
+#endif /* APRS */
+
+  data->fFix = temp->fFix;                                  // binary form of all this
+  data->fChanged = changed;
+  parser->fChanged = 0;
+
+  // finally manipulate the status bits ...
+  if ( GpsDataIsValid( temp ) ) GpsDataSetValid( data );
+
+  GpsDataSetComplete( data );
+  GpsDataClear( temp );
+
+  // now the sentence of the next epoch which completed this one
+  GpsSentencePending( parser );
+
+} // End GpsParserUpdate(GpsParser_t *parser, GpsData_t *data, ...)
+
+/* ------------------------------------------------------------------------- */
+
+/** Where a field of a sentence is stored, see gGpsField. */
+typedef struct {
+  unsigned char  fOffset;              // of the buffer in GpsData_t
+  unsigned char  fSize;                // characters kept, 0: not decoded
+} GpsField_t;
+
+/** Number of fields per sentence type in gGpsField. */
+#define GPS_FIELDS  9
+
+/** Field stored in buffer '_member' of GpsData_t, keeping the trailing '\0'. */
+#define GpsFieldString(_member) \
+  { offsetof( GpsData_t, _member ), sizeof(((GpsData_t *)0)->_member) - 1 }
+
+/** Single character field stored in '_member'. */
+#define GpsFieldChar(_member)   { offsetof( GpsData_t, _member ), 1 }
+
+/** The time field, its milliseconds are converted even if fTime is too
+  * short to keep them (see GpsFieldStore()). */
+#define GpsFieldTime()          { offsetof( GpsData_t, fTime ), 10 }
+
+/** Field which only changes the status bits (see GpsFieldStore()). */
+#define GpsFieldStatus()        { offsetof( GpsData_t, fStatus ), 1 }
+
+/** The decoded fields 1 ... GPS_FIELDS of GPRMC, GPGGA and GPVTG. */
+static const GpsField_t gGpsField[kGPVTG][GPS_FIELDS] PROGMEM = {
+
+  //
+  // example of $GPRMC sentence:
+  //
+  // "$GPRMC,111148,A,4905.7046,N,00826.0110,E,000.0,069.4,070709,000.1,E*78"
+  //
+  // = Recommended Minimum Specific GNSS Data
+  //
+
+  [kGPRMC - 1] = {
+    [0] = GpsFieldTime(),                       // Time field, same as GPGGA
+    [1] = GpsFieldStatus(),                     // 'A' = valid, 'V' = invalid
+                                                // 3 ... 6: position, taken
+                                                // from GPGGA
+#ifdef APRS
+    [6] = GpsFieldString( fSpeed ),             // Speed field [km/h]
+    [7] = GpsFieldString( fCourse ),            // Course field [degrees]
+#else
+    [8] = GpsFieldString( fDate ),              // Date field
+#endif /* APRS */
+  },
+
+  //
+  // example of $GPGGA sentence:
+  //
+  // "$GPGGA,111148,4905.7046,N,00826.0110,E,1,04,5.1,130.6,M,47.9,M,,*41"
+  //
+  // = Global Positioning System Fixed Data
+  //
+
+  [kGPGGA - 1] = {
+    [0] = GpsFieldTime(),                       // Time field
+    [1] = GpsFieldString( fLatitude ),          // Latitude field
+    [2] = GpsFieldChar( fNorthSouth ),          // N/S indicator
+    [3] = GpsFieldString( fLongitude ),         // Longitude field
+    [4] = GpsFieldChar( fEastWest ),            // E/W indicator
+    [5] = GpsFieldStatus(),                     // GPS quality indication
+    [6] = GpsFieldString( fSatellites ),        // Satellite field
+#ifndef APRS
+    [7] = GpsFieldString( fHDOP ),              // HDOP field
+#endif /* APRS */
+    [8] = GpsFieldString( fAltitude ),          // MSL Altitude field [meters]
+  },
+
+  //
+  // Example of $GPVTG sentence:
+  //
+  // "$GPVTG,128.74,T,,M,0.15,N,0.3,K*6F"
+  //
+  // = Course Over Ground and Ground Speed
+  //
+
+  [kGPVTG - 1] = {
+    [0] = GpsFieldString( fCourse ),            // 'True' heading [degrees]
+                                                // 3: 'Magnetic' heading,
+                                                // 5: Speed field [knots]
+    [6] = GpsFieldString( fSpeed ),             // Speed field [km/h]
+  }
+};
+
+static GpsField_t GpsFieldLookup(const GpsParser_t *parser,
+                                 unsigned char number)
+/*
+ * ABSTRACT:	Look up where field 'number' of the current sentence is
+ *		stored.
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		number		Field number, 1 is the one behind the address
+ * OUTPUT:	None
+ * RETURN:	The field, its fSize is 0 if it is not decoded
+ */
+ {
+  GpsField_t        field = { 0, 0 };
+  const GpsField_t *entry;
+
+  if ( parser->fSentenceType < kGPRMC || parser->fSentenceType > kGPVTG ||
+       number < 1 || number > GPS_FIELDS )
+    return field;
+
+  entry = &gGpsField[parser->fSentenceType - 1][number - 1];
+
+  field.fOffset = pgm_read_byte( &entry->fOffset );
+  field.fSize   = pgm_read_byte( &entry->fSize );
+
+  return field;
+
+} // End GpsFieldLookup(const GpsParser_t *parser, unsigned char number)
+
+/* ------------------------------------------------------------------------- */
+
+static unsigned char GpsLastField(EGPSSentenceType type)
+/*
+ * ABSTRACT:	Number of the last field of a sentence type which is
+ *		evaluated, all following fields may be skipped.
+ *
+ * INPUT:	type		Sentence type
+ * OUTPUT:	None
+ * RETURN:	Field number, 0 if nothing of the sentence is evaluated
+ */
+ {
+  switch ( type ) {
+
+    case kGPGGA: return 9;			// MSL Altitude field
+#ifndef APRS
+    case kGPRMC: return 9;			// Date field
+    case kGPVTG: return 7;			// Speed field [km/h]
+#else
+    case kGPRMC: return 8;			// Course field
+#endif /* APRS */
+
+    default:     return 0;
+  }
+
+} // End GpsLastField(EGPSSentenceType type)
+
+/* ------------------------------------------------------------------------- */
+
+static int32_t GpsFixDecimal(const char *field, unsigned char len,
+                             unsigned char decimals)
+/*
+ * ABSTRACT:	Convert a decimal number like "-123.45" into fixed point,
+ *		further digits behind the point are cut off.
+ *
+ * INPUT:	field		Characters of the field
+ *		len		Number of characters in 'field'
+ *		decimals	Number of digits behind the point
+ * OUTPUT:	None
+ * RETURN:	The number * 10^decimals
+ */
+ {
+  const char    *end = field + len;
+  const char    *ptr = field;
+  int32_t        value = 0;
+  unsigned char  digit;
+
+  if ( len && field[0] == '-' ) ptr++;
+
+  for ( ; ptr < end && (digit = *ptr - '0') <= 9; ptr++ )
+    value = value * 10 + digit;
+
+  if ( ptr < end && *ptr == '.' ) ptr++;
+
+  for ( ; decimals; decimals-- ) {		// missing digits count as '0'
+    digit = ptr < end ? *ptr - '0' : 10;
+    value = value * 10 + (digit <= 9 ? digit : 0);
+    ptr = digit <= 9 ? ptr + 1 : end;
+  }
+
+  return ( len && field[0] == '-' ) ? -value : value;
+
+} // End GpsFixDecimal(const char *field, unsigned char len, ...)
+
+/* ------------------------------------------------------------------------- */
+
+static uint32_t GpsFixTime(const char *field, unsigned char len)
+/*
+ * ABSTRACT:	Convert a time field "HHMMSS" or "HHMMSS.sss".
+ *
+ * INPUT:	field		Characters of the field
+ *		len		Number of characters in 'field'
+ * OUTPUT:	None
+ * RETURN:	Milliseconds of the day
+ */
+ {
+  uint32_t  seconds;
+
+  if ( len < 6 ) return 0;
+
+  seconds = ((field[0] - '0') * 10 + (field[1] - '0')) * 3600UL
+          + ((field[2] - '0') * 10 + (field[3] - '0')) * 60
+          +  (field[4] - '0') * 10 + (field[5] - '0');
+
+  if ( len == 10 && field[6] == '.' &&		// the usual ".sss"
+       (unsigned char)(field[7] - '0') <= 9 &&
+       (unsigned char)(field[8] - '0') <= 9 &&
+       (unsigned char)(field[9] - '0') <= 9 )
+    return seconds * 1000 + (field[7] - '0') * 100 + (field[8] - '0') * 10
+                          + (field[9] - '0');
+
+  return seconds * 1000 + GpsFixDecimal( field + 6, len - 6, 3 );
+
+} // End GpsFixTime(const char *field, unsigned char len)
+
+/* ------------------------------------------------------------------------- */
+
+static int32_t GpsFixAngle(const char *field, unsigned char len,
+                           unsigned char negative)
+/*
+ * ABSTRACT:	Convert a latitude "DDMM.MMMM" or longitude "DDDMM.MMMM".
+ *
+ *		The minutes are rounded up, thus an angle on the border
+ *		of a locator square doesn't end up in the one below.
+ *
+ * INPUT:	field		Characters of the field
+ *		len		Number of characters in 'field'
+ *		negative	kTRUE for south resp. west
+ * OUTPUT:	None
+ * RETURN:	The angle in 1e-7 degrees
+ */
+ {
+  int32_t        degrees;
+  uint32_t       minutes;			// 1e-4 minutes
+  unsigned char  point;
+
+  for ( point = 0; point < len && field[point] != '.'; point++ );
+
+  if ( point < 2 ) return 0;
+
+  degrees = GpsFixDecimal( field, point - 2, 0 );
+  if ( degrees < 0 || degrees > 180 ) return 0;	// garbage
+
+  minutes = GpsFixDecimal( field + point - 2, len - point + 2, 4 );
+
+  degrees = degrees * 10000000 + (minutes * 50 + 2) / 3;
+
+  return negative ? -degrees : degrees;
+
+} // End GpsFixAngle(const char *field, unsigned char len, ...)
+
+/* ------------------------------------------------------------------------- */
+
+/** Store '_value' in member '_member' of the fix, flag '_bit' if it changed
+  * (or the characters of the field did). */
+#define GpsFixSet(_member,_value,_bit) \
+  { __typeof__(fix->_member) _v = (_value); \
+    if ( text || fix->_member != _v ) { fix->_member = _v; parser->fChanged |= (_bit); } }
+
+static void GpsFieldConvert(GpsParser_t *parser, unsigned char offset,
+                            const char *field, unsigned char len,
+                            unsigned char text)
+/*
+ * ABSTRACT:	Convert a field just stored into the binary GpsFix_t, flag
+ *		the field if its value changed.
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		offset		Offset of the field's buffer in GpsData_t
+ *		field		Characters of the field
+ *		len		Number of characters in 'field'
+ *		text		kTRUE if the stored characters changed, e.g.
+ *				"0" -> "00", the field is flagged anyway
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  GpsData_t *temp = &parser->fData;
+  GpsFix_t  *fix = &temp->fFix;
+
+  switch ( offset ) {
+
+    case offsetof( GpsData_t, fTime ):		// converted by GpsSentenceTime()
+        GpsFixSet( fTime, parser->fEpoch, kFieldTime );
+        break;
+
+#ifndef APRS
+    case offsetof( GpsData_t, fDate ):
+        GpsFixSet( fDate, GpsFixDecimal( field, len, 0 ), kFieldDate );
+        break;
+#endif /* APRS */
+
+    case offsetof( GpsData_t, fLatitude ):
+        GpsFixSet( fLatitude,
+                   GpsFixAngle( field, len, temp->fNorthSouth[0] == 'S' ),
+                   kFieldLatitude );
+        break;
+
+    case offsetof( GpsData_t, fNorthSouth ):
+        GpsFixSet( fLatitude, (field[0] == 'S') != (fix->fLatitude < 0)
+                              ? -fix->fLatitude : fix->fLatitude,
+                   kFieldLatitude );
+        break;
+
+    case offsetof( GpsData_t, fLongitude ):
+        GpsFixSet( fLongitude,
+                   GpsFixAngle( field, len, temp->fEastWest[0] == 'W' ),
+                   kFieldLongitude );
+        break;
+
+    case offsetof( GpsData_t, fEastWest ):
+        GpsFixSet( fLongitude, (field[0] == 'W') != (fix->fLongitude < 0)
+                               ? -fix->fLongitude : fix->fLongitude,
+                   kFieldLongitude );
+        break;
+
+    case offsetof( GpsData_t, fAltitude ):
+        GpsFixSet( fAltitude, GpsFixDecimal( field, len, 2 ), kFieldAltitude );
+        break;
+
+    case offsetof( GpsData_t, fSpeed ):
+        GpsFixSet( fSpeed, GpsFixDecimal( field, len, 1 ), kFieldSpeed );
+        break;
+
+    case offsetof( GpsData_t, fCourse ):
+        GpsFixSet( fCourse, GpsFixDecimal( field, len, 2 ), kFieldCourse );
+        break;
+
+#ifndef APRS
+    case offsetof( GpsData_t, fHDOP ):
+        GpsFixSet( fHDOP, GpsFixDecimal( field, len, 1 ), kFieldHDOP );
+        break;
+#endif /* APRS */
+
+    case offsetof( GpsData_t, fSatellites ):
+        GpsFixSet( fSatellites, GpsFixDecimal( field, len, 0 ),
+                   kFieldSatellites );
+        break;
+  }
+
+} // End GpsFieldConvert(GpsParser_t *parser, unsigned char offset, ...)
+
+/* ------------------------------------------------------------------------- */
+
+/** Copy '_n' characters of a field, fields are too short for memcpy(). */
+#define GpsFieldCopy(_dest,_src,_n) \
+  { for ( unsigned char _i=0; _i<(_n); _i++ ) (_dest)[_i] = (_src)[_i]; }
+
+/* ------------------------------------------------------------------------- */
+
+static void GpsFieldStore(GpsParser_t *parser, unsigned char number,
+                          const char *chars, unsigned char len)
+/*
+ * ABSTRACT:	Store field 'number' of a verified sentence, terminate it -
+ *		thus no characters of a longer, older value remain - and
+ *		convert it. An empty field keeps the old value.
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		number		Field number, 1 is the one behind the address
+ *		chars		Characters of the field
+ *		len		Number of characters in 'chars'
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  const GpsField_t  field = GpsFieldLookup( parser, number );
+  GpsData_t        *temp = &parser->fData;
+  char             *dest = (char *)temp + field.fOffset;
+  unsigned char     keep;
+  unsigned char     text;
+
+  if ( !field.fSize || !len )			// not decoded resp. empty
+    return;
+
+  if ( field.fOffset == offsetof( GpsData_t, fStatus ) ) {
+
+    const char status = chars[len - 1];	// the last character counts
+
+    if ( parser->fSentenceType == kGPGGA ? status == '1' || status == '2'
+                                         : status == 'A' )
+      { GpsDataSetValid( temp ); }
+    else
+      { GpsDataSetInvalid( temp ); }
+
+    return;
+  }
+
+  if ( len > field.fSize ) len = field.fSize;	// never beyond the field's end
+
+  keep = len;
+  if ( field.fOffset == offsetof( GpsData_t, fTime ) &&
+       keep > sizeof(temp->fTime) - 1 )
+    keep = sizeof(temp->fTime) - 1;		// HHMMSS only
+
+  // copy it, the field is flagged as changed (see GpsParserUpdate()) even
+  // if only its characters changed
+
+  text = 0;
+
+  if ( keep < field.fSize ) {			// shorter than before ?
+    text = dest[keep];
+    dest[keep] = 0;
+  }
+
+  for ( unsigned char i=0; i<keep; i++ ) {	// without a branch per character
+    text |= dest[i] ^ chars[i];
+    dest[i] = chars[i];
+  }
+
+  GpsFieldConvert( parser, field.fOffset, chars, len, text != 0 );
+
+} // End GpsFieldStore(GpsParser_t *parser, unsigned char number, ...)
+
+/* ------------------------------------------------------------------------- */
+
+static void GpsFieldAppend(GpsParser_t *parser, const char *chars, size_t len)
+/*
+ * ABSTRACT:	Stage characters of the current field of the sentence, but
+ *		not more than GpsFieldStore() keeps. Of a status field only
+ *		the last character is kept.
+ *
+ *		Thus the staged fields of a sentence fit into fStage (see
+ *		GPS_STAGE_SIZE).
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		chars		Next characters of the field
+ *		len		Number of characters in 'chars'
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  const GpsField_t field = GpsFieldLookup( parser, parser->fCommas );
+
+  if ( !field.fSize || !len )			// not decoded resp. nothing
+    return;
+
+  if ( field.fOffset == offsetof( GpsData_t, fStatus ) ) {
+
+    if ( parser->fIndex == 0 ) {
+      parser->fIndex = 1;
+      parser->fStaged++;
+    }
+    parser->fStage[parser->fStaged - 1] = chars[len - 1];
+
+    return;
+  }
+
+  if ( len > (size_t)(field.fSize - parser->fIndex) )
+    len = field.fSize - parser->fIndex;
+
+  GpsFieldCopy( &parser->fStage[parser->fStaged], chars, len );
+  parser->fStaged += len;
+  parser->fIndex  += len;
+
+} // End GpsFieldAppend(GpsParser_t *parser, const char *chars, size_t len)
+
+/* ------------------------------------------------------------------------- */
+
+/** Count a comma of the sentence. The count saturates, thus the fields of a
+  * long junk line never wrap around to a decoded field number again. */
+#define GpsCommaAdd(_parser) \
+  { if ( (_parser)->fCommas != 0xff ) (_parser)->fCommas += 1; }
+
+static inline void GpsFieldNext(GpsParser_t *parser)
+/*
+ * ABSTRACT:	A comma ends the current field (but the address), the
+ *		staged fields are separated by a comma, too.
+ *
+ * INPUT:	parser		Parser context of the stream
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  GpsCommaAdd( parser );
+  parser->fIndex = 0;
+
+  if ( parser->fCommas > 1 &&
+       parser->fCommas <= GpsLastField( parser->fSentenceType ) )
+    parser->fStage[parser->fStaged++] = ',';
+
+} // End GpsFieldNext(GpsParser_t *parser)
+
+/* ------------------------------------------------------------------------- */
+
+static void GpsSentenceStore(GpsParser_t *parser)
+/*
+ * ABSTRACT:	Store the staged fields of a verified sentence.
+ *
+ * INPUT:	parser		Parser context of the stream
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  const char    *field = parser->fStage;
+  const char    *end = field + parser->fStaged;
+  const char    *next;
+  unsigned char  number = 1;
+
+  for (;;) {
+
+    for ( next = field; next < end && *next != ','; next++ );
+
+    GpsFieldStore( parser, number++, field, next - field );
+
+    if ( next == end ) break;
+
+    field = next + 1;
+  }
+
+  if ( parser->fSentenceType == kGPRMC || parser->fSentenceType == kGPGGA )
+    GpsDataSetComplete( &parser->fData );
+
+} // End GpsSentenceStore(GpsParser_t *parser)
+
+/* ------------------------------------------------------------------------- */
+
+static void GpsSentencePending(GpsParser_t *parser)
+/*
+ * ABSTRACT:	Store the staged sentence which started the next epoch (see
+ *		kEpochLast): the fix of the epoch in front of it has been
+ *		taken - or is skipped, as the stream goes on.
+ *
+ * INPUT:	parser		Parser context of the stream
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  if ( !(parser->fEpochFlags & kEpochLast) )
+    return;
+
+  parser->fEpochFlags &= ~kEpochLast;
+
+  GpsSentenceStore( parser );
+
+} // End GpsSentencePending(GpsParser_t *parser)
+
+/* ------------------------------------------------------------------------- */
+
+/** Perfect hash table of the supported talkers, slot (t[0] + t[1]) & 7. */
+static const char gGpsTalker[8][2] PROGMEM = {
+  [0] = "GA",                                   // Galileo
+  [3] = "GL",                                   // GLONASS
+  [5] = "GN",                                   // combined GNSS
+  [6] = "BD",                                   // BeiDou
+  [7] = "GP"                                    // GPS
+};
+
+/** Entry of the sentence table below. */
+typedef struct {
+  char           fName[3];
+  unsigned char  fType;
+} GpsSentenceName_t;
+
+/** Perfect hash table of the known sentences, slot (s[0] + s[1] + s[2]) & 7. */
+static const GpsSentenceName_t gGpsSentence[8] PROGMEM = {
+  [0] = { "GSV", kGPGSV },
+#ifndef APRS
+  [1] = { "VTG", kGPVTG },                      // course & speed from RMC
+#endif /* APRS */
+  [2] = { "RMC", kGPRMC },
+  [3] = { "GSA", kGPGSA },
+  [7] = { "GGA", kGPGGA }
+};
+
+static EGPSSentenceType GpsSentenceLookup(const char *address, size_t len)
+/*
+ * ABSTRACT:	Detect the NMEA sentence type from the address field, the
+ *		talker ID (2 characters) and the sentence ID (3 characters)
+ *		are looked up in a perfect hash table each, thus everything
+ *		else is rejected with at most two compares.
+ *
+ * INPUT:	address		Characters of the address field
+ *		len		Number of characters in 'address'
+ * OUTPUT:	None
+ * RETURN:	Sentence type, kNONE if not supported
+ */
+ {
+  const unsigned char     *id = (const unsigned char *)address;
+  const char              *talker;
+  const GpsSentenceName_t *sentence;
+
+  if ( len != 5 )				// e.g. proprietary sentences
+    return kNONE;
+
+  talker = gGpsTalker[(id[0] + id[1]) & 7];
+
+  if ( pgm_read_byte( &talker[0] ) != id[0] ||
+       pgm_read_byte( &talker[1] ) != id[1] )
+    return kNONE;
+
+  sentence = &gGpsSentence[(id[2] + id[3] + id[4]) & 7];
+
+  if ( pgm_read_byte( &sentence->fName[0] ) != id[2] ||
+       pgm_read_byte( &sentence->fName[1] ) != id[3] ||
+       pgm_read_byte( &sentence->fName[2] ) != id[4] )
+    return kNONE;
+
+  return (EGPSSentenceType)pgm_read_byte( &sentence->fType );
+
+} // End GpsSentenceLookup(const char *address, size_t len)
+
+/* ------------------------------------------------------------------------- */
+
+static void GpsChecksumDigit(GpsParser_t *parser, unsigned char newchar)
+/*
+ * ABSTRACT:	Read one character of the '*hh' checksum field.
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		newchar		Character behind the '*'
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  unsigned char value;
+
+  if ( newchar == '\r' )			// part of the line end
+    return;
+
+  if ( newchar >= '0' && newchar <= '9' )
+    value = newchar - '0';
+  else if ( newchar >= 'A' && newchar <= 'F' )
+    value = newchar - 'A' + 10;
+  else if ( newchar >= 'a' && newchar <= 'f' )
+    value = newchar - 'a' + 10;
+  else {
+    parser->fChecksumState = kChecksumBad;
+    return;
+  }
+
+  if ( parser->fChecksumState >= kChecksumDone ) {	// more than two digits
+    parser->fChecksumState = kChecksumBad;
+    return;
+  }
+
+  parser->fChecksumField = (parser->fChecksumField << 4) | value;
+  parser->fChecksumState += 1;
+
+} // End GpsChecksumDigit(GpsParser_t *parser, unsigned char newchar)
+
+/* ------------------------------------------------------------------------- */
+
+static unsigned char GpsEpochAdd(GpsParser_t *parser, uint32_t time)
+/*
+ * ABSTRACT:	Add the sentence just verified to its epoch. GPRMC and
+ *		GPGGA carry the time of the epoch, a different time - or a
+ *		type already received - starts the next one. GPVTG has no
+ *		time, it belongs to the current epoch.
+ *
+ *		The epoch is complete with the sentence type which was the
+ *		last one of the previous epoch. If the next epoch starts
+ *		first, the pending one is complete, too: the sentence is
+ *		then stored behind its fix (kEpochLast).
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		time		UTC time of the sentence (ms), see
+ *				GpsSentenceTime()
+ * OUTPUT:	None
+ * RETURN:	kTRUE if an epoch is complete, kFALSE otherwise
+ */
+ {
+  const uint8_t type = 1 << parser->fSentenceType;
+
+  if ( parser->fSentenceType != kGPVTG ) {
+
+    if ( time != parser->fEpoch || (parser->fEpochSeen & type) ) {
+
+      const unsigned char timed = parser->fEpochSeen & ~(1 << kGPVTG);
+      const unsigned char pending = timed &&
+                                    !(parser->fEpochFlags & kEpochDone);
+
+      if ( timed )				// learn from the last epoch
+        parser->fEpochEnd = parser->fEpochType;
+
+      parser->fEpoch = time;
+      parser->fEpochSeen = type;
+      parser->fEpochType = parser->fSentenceType;
+      parser->fEpochFlags = pending ? kEpochLast : 0;
+
+      if ( pending ) return kTRUE;		// report it before this one
+    }
+  }
+  else if ( parser->fEpochFlags & kEpochDone )
+    return kFALSE;				// for the next fix
+
+  parser->fEpochSeen |= type;
+  parser->fEpochType = parser->fSentenceType;
+
+  if ( (parser->fEpochFlags & kEpochDone) ||
+       parser->fSentenceType != parser->fEpochEnd )
+    return kFALSE;
+
+  parser->fEpochFlags |= kEpochDone;
+
+  return kTRUE;
+
+} // End GpsEpochAdd(GpsParser_t *parser, uint32_t time)
+
+/* ------------------------------------------------------------------------- */
+
+/** kTRUE if the sentence has no checksum field or a correct one. */
+#define GpsChecksumIsValid(_parser) \
+  ( (_parser)->fChecksumState == kChecksumBody || \
+    ( (_parser)->fChecksumState == kChecksumDone && \
+      (_parser)->fChecksumField == (_parser)->fChecksum ) )
+
+static uint32_t GpsSentenceTime(GpsParser_t *parser, const char *field,
+                                unsigned char len)
+/*
+ * ABSTRACT:	UTC time of the current sentence, the one before if its
+ *		time field is empty.
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		field		Characters of the time field
+ *		len		Number of characters in 'field'
+ * OUTPUT:	None
+ * RETURN:	Milliseconds of the day
+ */
+ {
+  const GpsField_t time = GpsFieldLookup( parser, 1 );
+
+  if ( !len )
+    return parser->fData.fFix.fTime;
+
+  if ( len > time.fSize ) len = time.fSize;	// as GpsFieldStore()
+
+  return GpsFixTime( field, len );
+
+} // End GpsSentenceTime(GpsParser_t *parser, const char *field, ...)
+
+/* ------------------------------------------------------------------------- */
+
+static unsigned char GpsSentenceEnd(GpsParser_t *parser)
+/*
+ * ABSTRACT:	Verify the checksum at the end of a sentence, a sentence
+ *		without checksum is accepted (it's optional in NMEA-0183).
+ *		The staged fields of a verified sentence are stored, the
+ *		ones of a corrupted sentence dropped.
+ *
+ * INPUT:	parser		Parser context of the stream
+ * OUTPUT:	None
+ * RETURN:	kTRUE if an epoch is complete, kFALSE otherwise
+ */
+ {
+  unsigned char  len;
+  unsigned char  complete;
+
+  if ( !GpsChecksumIsValid( parser ) ) {
+
+    parser->fChecksumErrors += 1;
+    GpsSentenceDrop( parser );			// corrupted on the line
+    return kFALSE;
+  }
+
+  parser->fChecksumState = kChecksumIdle;
+  parser->fSentences += 1;
+
+  if ( !GpsLastField( parser->fSentenceType ) )
+    return kFALSE;				// nothing decoded
+
+  for ( len = 0; len < parser->fStaged && parser->fStage[len] != ','; len++ );
+
+  complete = GpsEpochAdd( parser,
+                          GpsSentenceTime( parser, parser->fStage, len ) );
+
+  if ( !(parser->fEpochFlags & kEpochLast) )	// else behind the fix
+    GpsSentenceStore( parser );
+
+  return complete;
+
+} // End GpsSentenceEnd(GpsParser_t *parser)
+
+/* ------------------------------------------------------------------------- */
+
+static void GpsSentenceStart(GpsParser_t *parser)
+/*
+ * ABSTRACT:	A '$' starts the next sentence, one cut off by it is
+ *		dropped.
+ *
+ * INPUT:	parser		Parser context of the stream
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  GpsSentencePending( parser );
+  GpsSentenceDrop( parser );
+
+  parser->fCommas = 0; 		       	// No commas detected in sentence for far
+  parser->fIndex = 0;				// No address characters either
+  parser->fSentenceType = kNONE;	       	// Clear local parse variable
+  parser->fChecksumState = kChecksumBody;
+  parser->fChecksum = 0;
+  parser->fStaged = 0;				// No fields staged
+
+} // End GpsSentenceStart(GpsParser_t *parser)
+
+/* ------------------------------------------------------------------------- */
+
+unsigned char GpsParserFeed(GpsParser_t *parser, unsigned char newchar)
+/*
+ * ABSTRACT:	Processes the characters coming in from USART.
+ *
+ *              In this case, this is the port connected to the gps receiver.
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		newchar		Next character from the serial port.
+ * OUTPUT:	None
+ * RETURN:	kTRUE if message complete, kFALSE otherwise
+ */
+ {
+  if (newchar == 0) {			       	// A NULL character resets GPS decoding
+    GpsParserReset( parser );
+    return kFALSE;
+  }
+
+  if (newchar == '$') { 		       	// Start of Sentence character, reset
+    GpsSentenceStart( parser );
+    return kFALSE;
+  }
 
-GpsData_t gGpsData;                             // externally visible variables
+  if (parser->fChecksumState == kChecksumIdle)	// Nothing up to the next '$'
+    return kFALSE;
 
-static GpsData_t gTempGpsData;			// Temporary variables used for decoding.
+  if (newchar == '\n')				// End of sentence, verify it
+    return GpsSentenceEnd( parser );
 
-char gAltitudeFeet[7];				// Altitude (feet) in FFFFFF format
+  if (parser->fChecksumState != kChecksumBody) {	// Inside the '*hh' field
+    GpsChecksumDigit( parser, newchar );
+    return kFALSE;
+  }
 
-#ifndef APRS
-char gLocator[7];				// Maidenhead locator
-#endif /* APRS */
+  if (newchar == '*') { 		       	// Checksum field follows
+    parser->fChecksumState = kChecksumDigit1;
+    parser->fChecksumField = 0;
+    return kFALSE;
+  }
+
+  parser->fChecksum ^= newchar;
+
+  if (newchar == ',') { 		       	// If there is a comma
+    if (parser->fCommas == 0)			// Address complete, look it up
+      parser->fSentenceType = GpsSentenceLookup( parser->fAddress, parser->fIndex );
+    GpsFieldNext( parser );			// Count it, reset the field index
+    return kFALSE;
+  }
+
+  // collect the address to detect the NMEA sentence type ...
+
+  if (parser->fCommas == 0) {
+    if (parser->fIndex < sizeof(parser->fAddress))
+      parser->fAddress[parser->fIndex] = newchar;
+    if (parser->fIndex <= sizeof(parser->fAddress))	// More is too long anyway
+      parser->fIndex++;
+    return kFALSE;
+  }
+
+  // stage the character, it is stored when the sentence is verified
+
+  GpsFieldAppend( parser, (const char *)&newchar, 1 );
 
-static EGPSSentenceType	gSentenceType;		// GPRMC, GPGGA, or unrecognized
+  return kFALSE;
+
+} // End GpsParserFeed(GpsParser_t *parser, unsigned char newchar)
 
 /* ------------------------------------------------------------------------- */
 
-void GpsMsgInit(void)
+// --- buffer parser of the host programs, the firmware is fed by the ISR
+//     character by character (GpsMsgHandler())
+
+#if !(defined __AVR__)
+
+/** Delimiter classes of the characters, see GpsFindDelimiter(). */
+static const unsigned char gGpsDelimiter[256] = {
+  [0] = 1, ['$'] = 1, ['\n'] = 1, ['*'] = 1, [','] = 2
+};
+
+static inline const char *GpsFindDelimiter(const char *buf, const char *end,
+                                           unsigned char commas)
 /*
- * ABSTRACT:	Initialize some of the fields in case we transmit before the GPS
- *				has lock and sends us valid data.
+ * ABSTRACT:	Find the next character which has to be passed to
+ *		GpsParserFeed(), i.e. one of '\0', '$', '\n', '*' or - if
+ *		requested - ',' (by a table lookup).
  *
- * INPUT:	None
+ * INPUT:	buf		First character to check
+ *		end		End of the buffer
+ *		commas		kTRUE if ',' is a delimiter, too
  * OUTPUT:	None
- * RETURN:	None
+ * RETURN:	Pointer to the delimiter, 'end' if there is none
  */
  {
-  memset( &gTempGpsData, sizeof(gTempGpsData), ' ');  // blanks everywhere
+  const unsigned char mask = commas ? 3 : 1;
 
-  // write terminating 0 to finish C strings properly
+  while ( buf < end && !(gGpsDelimiter[(unsigned char)*buf] & mask) )
+    buf++;
 
-  gTempGpsData.fTime[sizeof(gTempGpsData.fTime) - 1]             =
-#ifndef APRS
-  gTempGpsData.fDate[sizeof(gTempGpsData.fDate) - 1]             =
-#endif /* APRS */
-  gTempGpsData.fLatitude[sizeof(gTempGpsData.fLatitude) - 1]     =
-  gTempGpsData.fLongitude[sizeof(gTempGpsData.fLongitude) - 1]   =
-  gTempGpsData.fAltitude[sizeof(gTempGpsData.fAltitude) - 1]     =
-  gTempGpsData.fSpeed[sizeof(gTempGpsData.fSpeed) - 1]           =
-  gTempGpsData.fCourse[sizeof(gTempGpsData.fCourse) - 1]         =
-#ifndef APRS
-  gTempGpsData.fHDOP[sizeof(gTempGpsData.fHDOP) - 1]             =
-#endif /* APRS */
-  gTempGpsData.fSatellites[sizeof(gTempGpsData.fSatellites) - 1] = 0;
+  return buf;
 
-  // special initialisations ...
+} // End GpsFindDelimiter(const char *buf, const char *end, ...)
 
-  gTempGpsData.fSpeed[0]      = gTempGpsData.fSpeed[1]
-                              = gTempGpsData.fSpeed[2]    = '0';
-  gTempGpsData.fCourse[0]     = gTempGpsData.fCourse[1]
-                              = gTempGpsData.fCourse[2]   = '0';
-  gTempGpsData.fAltitude[0]   = gTempGpsData.fAltitude[1] = '0';
-  gTempGpsData.fAltitude[2]   = '.';
+/* ------------------------------------------------------------------------- */
 
-  gTempGpsData.fNorthSouth[0] = 'N';
-  gTempGpsData.fEastWest[0]   = 'E';
+static inline void GpsChecksumUpdate(GpsParser_t *parser,
+                                     const char *buf, const char *end)
+/*
+ * ABSTRACT:	Add the characters buf[0] ... end[-1] of the sentence body
+ *		to its checksum, a vector at a time.
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		buf, end	Range of characters
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  parser->fChecksum ^= GpsIndexChecksum( buf, end - buf );
 
-} // End GpsMsgInit
+} // End GpsChecksumUpdate(GpsParser_t *parser, const char *buf, ...)
 
 /* ------------------------------------------------------------------------- */
 
-void GpsMsgPrepare(void)
+static size_t GpsParserParseSpan(GpsParser_t *parser, const char *buf,
+                                 size_t from, size_t to,
+                                 GpsSentenceCallback_t callback, void *arg)
 /*
- * ABSTRACT:	Call this function right before sending a position report for two
- *				reasons. This copies all the temp strings into transmit strings so
- *				they are not modified by the GPS receive handler.  Altitude is also
- *				converted into feet from meters.
+ * ABSTRACT:	Processes the characters buf[from] ... buf[to-1], the result
+ *		is the same as feeding each of them into GpsParserFeed().
  *
- * INPUT:	None
+ *		Only the sentence address is processed character by
+ *		character, field contents are copied at once and fields
+ *		or sentences which are not decoded are skipped (the comma
+ *		count is not kept up to date behind the last decoded field).
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		buf		Characters read from the stream
+ *		from, to	Range of characters to process
+ *		callback	Called for each completed sentence (may be NULL)
+ *		arg		Passed to 'callback'
  * OUTPUT:	None
- * RETURN:	None
+ * RETURN:	Number of completed sentences
  */
  {
-  GpsDataClear( &gGpsData );
+  const char    *ptr = buf + from;
+  const char    *end = buf + to;
+  const char    *next;
+  const char    *stop;
+  size_t         sentences = 0;
 
-#if (defined GPS_NAVILOCK)
-  gTempGpsData.fTime[6] = 0;                                // cut '.sss' part of the data
-#endif /* GPS_NAVILOCK */
-  strcpy( gGpsData.fTime, gTempGpsData.fTime ); 	    // latest Time
+  while ( ptr < end ) {
 
-#ifndef APRS
-  strcpy( gGpsData.fDate, gTempGpsData.fDate ); 	    // latest Date
-#endif /* APRS */
+    if ( parser->fChecksumState == kChecksumIdle && *ptr != '$' && *ptr != 0 ) {
 
-  strcpy( gGpsData.fLatitude, gTempGpsData.fLatitude );     // latest Latitude
-  if ( gGpsData.fLatitude[0] == '0' )                       // remove leading '0' in degrees field
-    gGpsData.fLatitude[0] = ' ';
-  gGpsData.fNorthSouth[0] = gTempGpsData.fNorthSouth[0];
+      // outside of a sentence, skip up to the next one (or reset)
 
-  strcpy( gGpsData.fLongitude, gTempGpsData.fLongitude );   // latest Longitude
-  for ( uint8_t i=0; i<2; i++ ) {                           // remove leading '0' in degrees field
-    if ( gGpsData.fLongitude[i] == '0' )
-      gGpsData.fLongitude[i] = ' ';
-    else
-      break;
-  }
-  gGpsData.fEastWest[0] = gTempGpsData.fEastWest[0];
+      next = memchr( ptr, '$', end - ptr );
+      if ( !next ) next = end;
+      if ( (stop = memchr( ptr, 0, next - ptr )) ) next = stop;
 
-  strcpy( gGpsData.fAltitude, gTempGpsData.fAltitude );     // latest Altitude
+      ptr = next;
+      continue;
+    }
 
-#ifndef APRS
-  for ( uint8_t i=0; i<sizeof(gTempGpsData.fSpeed); i++ )       // skip fractional value
-    if (  gTempGpsData.fSpeed[i] == '.' ) {
-      gTempGpsData.fSpeed[i] = 0;
-      break;
+    if ( *ptr == ',' && parser->fCommas && parser->fChecksumState == kChecksumBody ) {
+      parser->fChecksum ^= ',';			// same as in GpsParserFeed()
+      GpsFieldNext( parser );
+      ptr++;
+      continue;
     }
 
-  static int16_t speed = -1;
+    if ( parser->fCommas == 0 || parser->fChecksumState != kChecksumBody ||
+         *ptr == 0 || *ptr == '$' || *ptr == '\n' || *ptr == '*' ) {
 
-  if ( speed == -1 )
-    speed = atoi( gTempGpsData.fSpeed );
-  else {
-    // check gradient, it foo high, use old value
-    if ( abs(speed - atoi( gTempGpsData.fSpeed ) ) > 50 )
-      itoa( speed, gTempGpsData.fSpeed, 10 );
-  }
+      // sentence address, checksum field and the other delimiters
 
-  speed = atoi( gTempGpsData.fSpeed );
+      if ( GpsParserFeed( parser, *ptr++ ) == kTRUE ) {
 
-  // course undefined if speed == 0 --> set to 0
-  if ( speed == 0 ) itoa( 0, gTempGpsData.fCourse, 10 );
-#endif /* APRS */
-  strcpy( gGpsData.fSpeed, gTempGpsData.fSpeed );	    // latest Speed
+        sentences++;
 
-#ifndef APRS
-  for ( uint8_t i=0; i<sizeof(gTempGpsData.fCourse); i++ )       // skip fractional value
-    if (  gTempGpsData.fCourse[i] == '.' ) {
-      gTempGpsData.fCourse[i] = 0;
-      break;
+        if ( callback ) callback( parser, ptr - buf, arg );
+      }
+      continue;
     }
-#endif /* APRS */
-  strcpy( gGpsData.fCourse, gTempGpsData.fCourse );	    // latest Course
 
-  strcpy( gGpsData.fSatellites, gTempGpsData.fSatellites ); // latest Satellites
+    // inside a field of the sentence
 
-#ifndef APRS
-  strcpy( gGpsData.fHDOP, gTempGpsData.fHDOP );             // latest HDOP
-#endif /* APRS */
+    if ( parser->fCommas > GpsLastField( parser->fSentenceType ) ) {
 
-#if (defined APRS) || (defined TEST)
-  // convert altitude string into feet
-  GpsCalculateFeet();
-#endif /* APRS || TEST */
+      // nothing (more) to decode, skip up to the checksum field
 
-  // finally manipulate the status bits ...
-  if ( GpsDataIsValid( &gTempGpsData ) ) GpsDataSetValid( &gGpsData );
+      next = GpsFindDelimiter( ptr, end, kFALSE );
+      GpsChecksumUpdate( parser, ptr, next );
 
-  GpsDataSetComplete( &gGpsData );
-  GpsDataClear( &gTempGpsData );
+      ptr = next;
+      continue;
+    }
+
+    next = GpsFindDelimiter( ptr, end, kTRUE );
+    GpsChecksumUpdate( parser, ptr, next );
+
+    GpsFieldAppend( parser, ptr, next - ptr );
+
+    ptr = next;
+  }
+
+  return sentences;
 
-} // End GpsMsgPrepare(void)
+} // End GpsParserParseSpan(GpsParser_t *parser, const char *buf, ...)
 
 /* ------------------------------------------------------------------------- */
 
-unsigned char GpsMsgHandler(unsigned char newchar)
+static size_t GpsParserParseIndexed(GpsParser_t *parser, const char *buf,
+                                    size_t base,
+                                    const GpsSentenceIndex_t *sentence,
+                                    GpsSentenceCallback_t callback, void *arg)
 /*
- * ABSTRACT:	Processes the characters coming in from USART.
+ * ABSTRACT:	Processes one sentence found by GpsIndexBuild(), the result
+ *		is the same as feeding it into GpsParserFeed().
  *
- *              In this case, this is the port connected to the gps receiver.
+ *		As the whole sentence is available, its checksum is verified
+ *		first (at once for the sentence body), a corrupted sentence
+ *		is not decoded at all. The fields are taken directly from the
+ *		comma mask of the index and dispatched field by field (see
+ *		gGpsField[]), they need no staging (but if the sentence is
+ *		stored behind the fix of the epoch before).
+ *
+ *		Sentences which end before the last decoded field, with a
+ *		'*' inside the fields or longer than GPS_INDEX_MAX_LENGTH
+ *		are left to GpsParserParseSpan().
  *
- * INPUT:	newchar		Next character from the serial port.
+ * INPUT:	parser		Parser context of the stream
+ *		buf		Characters read from the stream
+ *		base		Offset of the indexed characters in 'buf'
+ *		sentence	Index of the sentence in 'buf + base'
+ *		callback	Called if the sentence is complete (may be NULL)
+ *		arg		Passed to 'callback'
  * OUTPUT:	None
- * RETURN:	kTRUE if message complete, kFALSE otherwise
+ * RETURN:	Number of completed sentences (0 or 1)
  */
  {
-  static unsigned char    commas;	       	// Number of commas for far in sentence
-  static unsigned char    index;	       	// Individual array index
+  const size_t   from = base + sentence->fStart;
+  const size_t   end = from + sentence->fLength + 1;
+  const char    *start = buf + from;
+  const char    *digit;
+  unsigned char  comma[GPS_FIELDS + 1];	// commas in front of each field
+  unsigned char  fields;
+  unsigned char  complete;
 
-  if (newchar == 0) {			       	// A NULL character resets GPS decoding
-    commas = 25;			       	// Set to an outrageous value
-    gSentenceType = kNONE;		       	// Clear local parse variable
-    GpsDataClear( &gTempGpsData );
-    return kFALSE;
-  }
+  comma[0] = GpsIndexComma( sentence, 0 );
 
-  if (newchar == '$') { 		       	// Start of Sentence character, reset
-    commas = 0; 			       	// No commas detected in sentence for far
-    gSentenceType = kNONE;		       	// Clear local parse variable
-    return kFALSE;
-  }
+  if ( sentence->fLength >= GPS_INDEX_MAX_LENGTH || comma[0] == GPS_INDEX_MAX_LENGTH ||
+       (sentence->fStar && GpsIndexComma( sentence, sentence->fStar ) < GPS_INDEX_MAX_LENGTH) )
+    return GpsParserParseSpan( parser, buf, from, end, callback, arg );
 
-  if (newchar == ',') { 		       	// If there is a comma
-    commas += 1;			       	// Increment the comma count
-    index = 0;  			       	// And reset the field index
-    return kFALSE;
+  GpsSentenceStart( parser );			// same as '$' in GpsParserFeed()
+  parser->fSentenceType = GpsSentenceLookup( start + 1, comma[0] - 1 );
+
+  fields = GpsLastField( parser->fSentenceType );
+
+  if ( GpsIndexFields( sentence, comma, fields + 1 ) <= fields ) {
+
+    parser->fCommas = 1;			// character by character
+    GpsChecksumUpdate( parser, start + 1, start + comma[0] + 1 );
+
+    return GpsParserParseSpan( parser, buf, from + comma[0] + 1, end,
+                               callback, arg );
   }
 
-  if ( (newchar == '\n') &&                      // If there is a newline char
-      (gSentenceType == kGPRMC || gSentenceType == kGPGGA) ) {
-    GpsDataSetComplete( &gTempGpsData );
-    return kTRUE;
+  parser->fCommas = fields + 1;			// nothing decoded behind
+
+  if ( sentence->fStar ) {			// same as in GpsParserFeed()
+
+    GpsChecksumUpdate( parser, start + 1, start + sentence->fStar );
+
+    parser->fChecksumState = kChecksumDigit1;
+    parser->fChecksumField = 0;
+
+    for ( digit = start + sentence->fStar + 1; digit < start + sentence->fLength; digit++ )
+      GpsChecksumDigit( parser, *digit );
   }
 
-  // detect NMEA sentence type ...
+  if ( !GpsChecksumIsValid( parser ) ) {	// corrupted, nothing decoded
+    parser->fChecksumErrors += 1;
+    GpsSentenceDrop( parser );
+    return 0;
+  }
 
-  if (commas == 0) {
+  parser->fChecksumState = kChecksumIdle;
+  parser->fSentences += 1;
 
-    switch (newchar) {
+  if ( !fields )				// nothing to decode
+    return 0;
 
-      case 'C':		      			// Only the GPRMC sentence contains a "C"
-  	  gSentenceType = kGPRMC; 		// Set local parse variable
-  	  break;
+  complete = GpsEpochAdd( parser,
+                          GpsSentenceTime( parser, start + comma[0] + 1,
+                                           comma[1] - comma[0] - 1 ) );
 
-      case 'S':		      			// Take note if sentence contains an "S"
-  	  gSentenceType = kGPGSA; 		// ...because we don't want to parse it
-  	  break;
+  // the fields go straight into their GpsData_t buffers, see gGpsField[]
 
-      case 'A':		      			// The GPGGA sentence ID contains "A"
-  	  if (gSentenceType != kGPGSA)    	// As does GPGSA, which we will ignore
-  	    gSentenceType = kGPGGA; 		// Set local parse variable
-  	  break;
-#ifndef APRS
-      case 'V':
-          gSentenceType = kGPVTG;
-  	  break;
-#endif /* APRS */
+  if ( parser->fEpochFlags & kEpochLast ) {	// stage them, see GpsSentenceEnd()
 
+    for ( unsigned char i=1; i<=fields; i++ ) {
+      parser->fCommas = i - 1;
+      GpsFieldNext( parser );
+      GpsFieldAppend( parser, start + comma[i-1] + 1, comma[i] - comma[i-1] - 1 );
     }
 
-    return kFALSE;
+    parser->fCommas = fields + 1;
+    parser->fIndex  = 0;
   }
+  else {
 
-  //
-  // example of $GPGGA sentence:
-  //
-  // "$GPGGA,111148,4905.7046,N,00826.0110,E,1,04,5.1,130.6,M,47.9,M,,*41"
-  //
-  // = Global Positioning System Fixed Data
-  //
+    for ( unsigned char i=1; i<=fields; i++ )
+      GpsFieldStore( parser, i, start + comma[i-1] + 1, comma[i] - comma[i-1] - 1 );
+
+    if ( parser->fSentenceType == kGPRMC || parser->fSentenceType == kGPGGA )
+      GpsDataSetComplete( &parser->fData );
+  }
+
+  if ( complete == kTRUE ) {
 
-  if (gSentenceType == kGPGGA) { 		// GPGGA sentence decode initiated
+    if ( callback ) callback( parser, end, arg );
+
+    return 1;
+  }
 
-    switch (commas) {
+  return 0;
 
-      case 1: 					// Time field
-  	  gTempGpsData.fTime[index++] = newchar;
-  	  return kFALSE;
+} // End GpsParserParseIndexed(GpsParser_t *parser, const char *buf, ...)
 
-      case 2: 					// Latitude field
-  	  gTempGpsData.fLatitude[index++] = newchar;
-  	  return kFALSE;
+/* ------------------------------------------------------------------------- */
 
-      case 3:					// N/S indicator
-          gTempGpsData.fNorthSouth[index++] = newchar;
-  	  return kFALSE;
+size_t GpsParserParse(GpsParser_t *parser, const char *buf, size_t len,
+                      GpsSentenceCallback_t callback, void *arg)
+/*
+ * ABSTRACT:	Processes a whole buffer of characters, the result is the
+ *		same as feeding each of them into GpsParserFeed().
+ *
+ *		The complete sentences are indexed in batches by
+ *		GpsIndexBuild() first, everything in between goes through
+ *		GpsParserParseSpan().
+ *
+ * INPUT:	parser		Parser context of the stream
+ *		buf		Characters read from the stream
+ *		len		Number of characters in 'buf'
+ *		callback	Called for each completed sentence (may be NULL)
+ *		arg		Passed to 'callback'
+ * OUTPUT:	None
+ * RETURN:	Number of completed sentences
+ */
+ {
+  GpsIndex_t  index;
+  size_t      done = 0;
+  size_t      covered;
+  size_t      sentences = 0;
 
-      case 4: 					// Longitude field
-  	  gTempGpsData.fLongitude[index++] = newchar;
-  	  return kFALSE;
+  while ( done < len ) {
 
-      case 5:					// E/W indicator
-          gTempGpsData.fEastWest[index++] = newchar;
-  	  return kFALSE;
+    const size_t base = done;
 
-#if 1
-      case 6: 					// GPS quality indication
-  	  if (newchar == '1' || newchar == '2')
-	    { GpsDataSetValid( &gTempGpsData ); }
-	  else
-	    { GpsDataSetInvalid( &gTempGpsData ); }
-	  return kFALSE;
-#endif
+    covered = base + GpsIndexBuild( &index, buf + base, len - base );
 
-      case 7: 					// Satellite field
-  	  gTempGpsData.fSatellites[index++] = newchar;
-  	  return kFALSE;
+    for ( size_t i=0; i<index.fCount; i++ ) {
 
-#ifndef APRS
-      case 8: 					// HDOP field
-  	  gTempGpsData.fHDOP[index++] = newchar;
-  	  return kFALSE;
-#endif /* APRS */
+      const GpsSentenceIndex_t *sentence = &index.fSentence[i];
+      const size_t              start = base + sentence->fStart;
 
-      case 9: 					// MSL Altitude field [meters]
-  	  gTempGpsData.fAltitude[index++] = newchar;
-  	  return kFALSE;
+      if ( done < start )			// garbage in between
+        sentences += GpsParserParseSpan( parser, buf, done, start,
+                                         callback, arg );
+      sentences += GpsParserParseIndexed( parser, buf, base, sentence,
+                                          callback, arg );
 
-#if 0
-      case 9: 					// Unit for MSL Altitude field
-  	  return kFALSE;
-#endif
+      done = start + sentence->fLength + 1;
     }
 
+    sentences += GpsParserParseSpan( parser, buf, done, covered, callback, arg );
+
+    done = covered;
+  }
+
+  return sentences;
+
+} // End GpsParserParse(GpsParser_t *parser, const char *buf, ...)
+
+#endif /* __AVR__ */
+
+/* ------------------------------------------------------------------------- */
+
+unsigned char GpsParserTimeout(GpsParser_t *parser)
+/*
+ * ABSTRACT:	The receiver is silent, thus the current epoch is complete
+ *		if its fix is still pending. Its last sentence type is the
+ *		one ending the epochs from now on.
+ *
+ * INPUT:	parser		Parser context of the stream
+ * OUTPUT:	None
+ * RETURN:	kTRUE if this completed an epoch, kFALSE otherwise
+ */
+ {
+  if ( !(parser->fEpochSeen & ~(1 << kGPVTG)) ||
+       (parser->fEpochFlags & kEpochDone) )
     return kFALSE;
 
-  } // end if (gSentenceType == kGPGGA)
+  GpsSentencePending( parser );			// the epoch's only sentence
 
-  //
-  // example of $GPRMC sentence:
-  //
-  // "$GPRMC,111148,A,4905.7046,N,00826.0110,E,000.0,069.4,070709,000.1,E*78"
-  //
-  // = Recommended Minimum Specific GNSS Data
-  //
+  parser->fEpochEnd = parser->fEpochType;
 
-  if (gSentenceType == kGPRMC) { 		// GPGGA sentence decode initiated
-
-    switch (commas) {
-
-      case 2:
-          if (newchar == 'A')  			// 'A' = valid, 'V' = invalid
-	    { GpsDataSetValid( &gTempGpsData ); }
-	  else
-	    { GpsDataSetInvalid( &gTempGpsData ); }
-          return kFALSE;
-
-#if 0
-      case 3: 					// Latitude field
-  	  gTempGpsData.fLatitude[index++] = newchar;
-  	  return kFALSE;
-#endif
-
-#if 0
-      case 4:					// N/S indicator
-          gTempGpsData.fNorthSouth[index++] = newchar;
-  	  return kFALSE;
-#endif
-
-#if 0
-      case 5: 					// Longitude field
-  	  gTempGpsData.fLongitude[index++] = newchar;
-  	  return kFALSE;
-#endif
-
-#if 0
-      case 6:					// E/W indicator
-          gTempGpsData.fEastWest[index++] = newchar;
-  	  return kFALSE;
-#endif
+  // a sentence started meanwhile is not part of the epoch, it is staged
+  // only
 
-#ifdef APRS
-      case 7: 					// Speed field [km/h]
-  	  gTempGpsData.fSpeed[index++] = newchar;
-  	  return kFALSE;
+  parser->fEpochFlags = kEpochDone;
 
-      case 8: 					// Course field [degrees]
-  	  gTempGpsData.fCourse[index++] = newchar;
-  	  return kFALSE;
-#endif /* APRS */
+  return kTRUE;
 
-#ifndef APRS
-      case 9: 					// Date field
-  	  gTempGpsData.fDate[index++] = newchar;
-  	  return kFALSE;
-#endif /* APRS */
-    }
+} // End GpsParserTimeout(GpsParser_t *parser)
 
-    return kFALSE;
+/* ------------------------------------------------------------------------- */
 
-  } // end if (gSentenceType == kGPRMC)
+void GpsMsgInit(void)
+ {
+  GpsParserInit( &gGpsParser );
+}
 
+/* ------------------------------------------------------------------------- */
+
+#if !(defined __AVR__)
+void GpsSnapshotPublish(GpsSnapshot_t *snapshot)
+/*
+ * ABSTRACT:	Publish the back buffer, which has to be complete: readers
+ *		may pick it up as soon as the sequence number changed.
+ *
+ * INPUT:	snapshot	The snapshot to be updated
+ * OUTPUT:	snapshot	Back buffer is the current fix now
+ * RETURN:	None
+ */
+ {
+  GpsBarrier();					// buffer written before ...
+
+  snapshot->fSequence++;			// ... it gets visible
+
+} // End GpsSnapshotPublish(GpsSnapshot_t *snapshot)
+
+/* ------------------------------------------------------------------------- */
+
+void GpsSnapshotLoad(const GpsSnapshot_t *snapshot, GpsData_t *out)
+/*
+ * ABSTRACT:	Copy the current fix. The writer only writes the back buffer,
+ *		but after a publication (during the copy) the buffer being
+ *		copied is the back buffer: the copy is repeated then.
+ *
+ * INPUT:	snapshot	The snapshot to be read
+ * OUTPUT:	out		Copy of the current fix
+ * RETURN:	None
+ */
+ {
+  uint8_t sequence;
+
+  do {
+    sequence = snapshot->fSequence;
+    GpsBarrier();				// sequence read before data ...
+
+    memcpy( out, &snapshot->fBuffer[sequence & 1], sizeof(*out) );
+
+    GpsBarrier();				// ... and data before re-check
+  } while ( sequence != snapshot->fSequence );
+
+} // End GpsSnapshotLoad(const GpsSnapshot_t *snapshot, GpsData_t *out)
+
+/* ------------------------------------------------------------------------- */
+
+void GpsSnapshotRead(GpsData_t *out)
+ {
+  GpsSnapshotLoad( &gGpsSnapshot, out );
+}
+#endif /* __AVR__ */
+
+/* ------------------------------------------------------------------------- */
+
+void GpsMsgPrepare(void)
+ {
+#if !(defined __AVR__)
+  // prepare the next fix aside, publishing it is a single increment; the
+  // back buffer lacks the changes of the current fix and of the next one
   //
-  // Example of $GPVTG sentence:
-  //
-  // "$GPVTG,128.74,T,,M,0.15,N,0.3,K*6F"
-  //
-  // = Course Over Ground and Ground Speed
+  GpsParserUpdate( &gGpsParser, GpsSnapshotBack( &gGpsSnapshot ),
+                   gGpsData.fChanged );
+  GpsSnapshotPublish( &gGpsSnapshot );
+#else
+  // the single buffer only lacks the changes of the next fix
   //
+  GpsParserUpdate( &gGpsParser, &gGpsData, 0 );
+#endif /* __AVR__ */
 
-  if ( gSentenceType == kGPVTG ) {
+#if (defined APRS) || (defined TEST)
+  // convert altitude string into feet
+  GpsCalculateFeet();
+#endif /* APRS || TEST */
+}
 
-    switch (commas) {
+/* ------------------------------------------------------------------------- */
 
-                                               // 'True' heading
-      case 1:                                  // Course field [degrees]
-          gTempGpsData.fCourse[index++] = newchar;
-          return kFALSE;
+#if !(defined __AVR__)
+void GpsMsgPrepareData(GpsData_t *data)
+ {
+  GpsParserPrepare( &gGpsParser, data );
+}
 
-#if 0
-      case 3:                                  // 'Magnetic' heading
-           return kFalse;
-#endif
+/* ------------------------------------------------------------------------- */
 
-#if 0
-      case 6:                                  // Speed field [knots]
-           return kFALSE;
-#endif
+void GpsMsgPublish(const GpsData_t *data)
+/*
+ * ABSTRACT:	Publish a fix prepared by GpsMsgPrepareData(), possibly in
+ *		another thread, the same way as GpsMsgPrepare() does.
+ *
+ * INPUT:	data		The fix
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  *GpsSnapshotBack( &gGpsSnapshot ) = *data;
+  GpsSnapshotPublish( &gGpsSnapshot );
 
-      case 7:                                  // Speed field [km/h]
-          gTempGpsData.fSpeed[index++] = newchar;
-          return kFALSE;
+#if (defined APRS) || (defined TEST)
+  // convert altitude string into feet
+  GpsCalculateFeet();
+#endif /* APRS || TEST */
 
-    }
+} // End GpsMsgPublish(const GpsData_t *data)
+#endif /* __AVR__ */
 
-    return kFALSE;
-  }
+/* ------------------------------------------------------------------------- */
 
-  return kFALSE;
+unsigned char GpsMsgHandler(unsigned char newchar)
+ {
+  return GpsParserFeed( &gGpsParser, newchar );
+}
+
+/* ------------------------------------------------------------------------- */
+
+#if !(defined __AVR__)
+size_t GpsMsgParseBuffer(const char *buf, size_t len,
+                         GpsSentenceCallback_t callback, void *arg)
+ {
+  return GpsParserParse( &gGpsParser, buf, len, callback, arg );
+}
+#endif /* __AVR__ */
 
-} // End MsgHandler(unsigned char newchar)
+/* ------------------------------------------------------------------------- */
+
+unsigned char GpsMsgTimeout(void)
+ {
+  return GpsParserTimeout( &gGpsParser );
+}
+
+/* ------------------------------------------------------------------------- */
+
+unsigned int GpsMsgRejected(void)
+ {
+#if !(defined __AVR__)
+  // may be called by another thread than the one parsing
+  return __atomic_load_n( &gGpsParser.fRejected, __ATOMIC_RELAXED );
+#else
+  return gGpsParser.fRejected;
+#endif /* __AVR__ */
+}
 
 /* ------------------------------------------------------------------------- */
 
 void GpsCalculateFeet(void)
  {
+  static GpsCacheRange_t  range;	// Altitudes (cm) of gAltitudeFeet
   static unsigned long    lAltitude;   	// Used to convert meters to feet
   static unsigned long    lTemp;       	// Just a long temp variable
   static unsigned char    index;	// For indexing local arrays
   static unsigned char    count;	// Keeps track of loops in F-to-A conv.
 
-  index = 0;						// Reset index for this search
-  gGpsData.fAltitude[6] = '.';  			// Force last character to a '.'
+  if ( GpsCacheHit( &range, gGpsData.fFix.fAltitude ) ) {
+    gAltitudeFeetCache.fHits++;			// Still the same foot
+    return;
+  }
 
-  while (gGpsData.fAltitude[++index] != '.');	  	// Find the decimal in Alt string
+  gAltitudeFeetCache.fMisses++;
 
-  lAltitude = 0;					// Begin with a blank slate
-  while (index) {		  			// This is Float-to-A, working from the decimal leftward
+  if ( gGpsData.fFix.fAltitude < 0 )		// FFFFFF has no sign
+    lAltitude = 0;
+  else
+    lAltitude = (unsigned long)gGpsData.fFix.fAltitude * 25 / 762; // cm / 30.48
+  // The lAltitude variable now contains the altitude in feet.
 
-    lAltitude += (gGpsData.fAltitude[--index] - 48) * lTemp; // Right to left
-    lTemp *= 10;					// Each digit is worth 10x previous
-  }
-  // The lAltitude variable now contains the altitude in meters.
+  if ( lAltitude > 999999 ) lAltitude = 999999;
 
-  // printf("lAltitude= %ld m\n",lAltitude);
+  // This foot starts at ceil(lAltitude * 30.48) cm, the next one at
+  // ceil((lAltitude + 1) * 30.48) cm - clipped ones reach to the end.
 
-  // The following is an approximation of 3.28 to convert Meters to Feet
-  lAltitude *= 3;					// Start by multiplying by 3
-  lAltitude += lAltitude>>4;		  		// add to self/16  (3.1875)
-  lAltitude += lAltitude>>6;		  		// add to self/64  (3.2373)
-  lAltitude += lAltitude>>7;		  		// add to self/128 (3.2626)
-  lAltitude += lAltitude>>8;		  		// add to self/256 (3.2758)
-  lAltitude += lAltitude>>10;	  	  		// add to self/1024 (3.279)
-  // The lAltitude variable now contains the altitude in feet.
+  range.fFrom = lAltitude ? (int32_t)( ( lAltitude * 762 + 24 ) / 25 )
+                          : INT32_MIN;
+  range.fTo   = lAltitude < 999999
+                ? (int32_t)( ( ( lAltitude + 1 ) * 762 + 24 ) / 25 )
+                : INT32_MAX;
 
   // This converts a long to ASCII with six characters & leading zeros.
   //
@@ -496,59 +1735,61 @@ void GpsCalculateFeet(void)
 // results in 6 char locator string in variable gLocator
 void GpsCalculateLocator(void)
  {
-  char temp[5];
-  uint16_t degrees;
-  uint8_t minutes;
+  static GpsCacheRange_t lonRange;	// longitudes of gLocator's subsquare
+  static GpsCacheRange_t latRange;	// latitudes of gLocator's subsquare
 
-  memset( gLocator, ' ', sizeof(gLocator));
-
-  // --- 1st character (20 degrees per 'digit')
+  if ( GpsCacheHit( &lonRange, gGpsData.fFix.fLongitude ) &&
+       GpsCacheHit( &latRange, gGpsData.fFix.fLatitude ) ) {
+    gLocatorCache.fHits++;
+    return;
+  }
 
-  strncpy( temp, gGpsData.fLongitude, 3 ); temp[3] = 0;
+  gLocatorCache.fMisses++;
 
-  if ( gGpsData.fEastWest[0] == 'W' )
-    degrees = 180 - atoi( temp );
-  else
-    degrees = 180 + atoi( temp );
+  // shift to 0 ... 360 resp. 0 ... 180 degrees (still 1e-7 degrees)
 
-  gLocator[0] = 'A' + degrees / 20;
+  uint32_t longitude = (uint32_t)gGpsData.fFix.fLongitude + 1800000000UL;
+  uint32_t latitude  = (uint32_t)gGpsData.fFix.fLatitude  +  900000000UL;
+  uint32_t base;
+  uint8_t  digit;
 
-  // --- 3rd character (2 degrees per 'digit', 120 minutes in total)
+  // --- 1st character (20 degrees per 'digit')
 
-  gLocator[2] = '0' + ((degrees % 20) >> 1);
+  gLocator[0] = 'A' + longitude / 200000000UL;
 
-  // --- 5th character (5 minutes per 'digit')
+  // --- 3rd character (2 degrees per 'digit')
 
-  strncpy( temp, &gGpsData.fLongitude[3], 2 ); temp[2] = 0;
+  gLocator[2] = '0' + (longitude % 200000000UL) / 20000000UL;
 
-  minutes = (degrees % 2) * 60 + atoi( temp );
+  // --- 5th character (5 minutes per 'digit', 24 per 2 degrees)
 
-  gLocator[4] = 'A' + minutes / 5;
+  digit = (longitude % 20000000UL) * 3 / 2500000UL;
+  gLocator[4] = 'A' + digit;
 
-  // --- 2nd character (10 degrees per 'digit')
+  // its longitudes: the 'digit'th 24th of the 2 degrees, rounded up
 
-  strncpy( temp, gGpsData.fLatitude, 2 ); temp[2] = 0;
+  base = longitude - longitude % 20000000UL - 1800000000UL;
+  lonRange.fFrom = (int32_t)( base + ( digit * 2500000UL + 2 ) / 3 );
+  lonRange.fTo   = (int32_t)( base + ( ( digit + 1 ) * 2500000UL + 2 ) / 3 );
 
-  if ( gGpsData.fNorthSouth[0] == 'S' )
-    degrees = 90 - atoi( temp );
-  else
-    degrees = 90 + atoi( temp );
+  // --- 2nd character (10 degrees per 'digit')
 
-  gLocator[1] = 'A' + degrees / 10;
+  gLocator[1] = 'A' + latitude / 100000000UL;
 
-  // --- 4th character (1 degree per 'digit', 60 minutes in total)
+  // --- 4th character (1 degree per 'digit')
 
-  gLocator[3] = '0' + degrees % 10;
+  gLocator[3] = '0' + (latitude % 100000000UL) / 10000000UL;
 
-  // --- 6th character (2.5 minutes per 'digit')
+  // --- 6th character (2.5 minutes per 'digit', 24 per degree)
 
-  strncpy( temp, &gGpsData.fLatitude[2], 2 ); temp[2] = 0;
+  digit = (latitude % 10000000UL) * 3 / 1250000UL;
+  gLocator[5] = 'A' + digit;
 
-  minutes = atoi( temp ) << 1;
-  if ( atoi(&gGpsData.fLatitude[5]) >= 5000 )
-    minutes += 1;
+  // its latitudes: the 'digit'th 24th of the degree, rounded up
 
-  gLocator[5] = 'A' + minutes / 5;
+  base = latitude - latitude % 10000000UL - 900000000UL;
+  latRange.fFrom = (int32_t)( base + ( digit * 1250000UL + 2 ) / 3 );
+  latRange.fTo   = (int32_t)( base + ( ( digit + 1 ) * 1250000UL + 2 ) / 3 );
 
   // finally add the trailing \000
 
@@ -574,6 +1815,7 @@ void GpsMsgShow(void)
   printf( "vel:   %s\n", gGpsData.fSpeed );
   printf( "dir:   %s\n", gGpsData.fCourse );
   printf( "sats:  %s\n", gGpsData.fSatellites );
+  printf( "rej:   %u\n", GpsMsgRejected() );
   printf( "---------------------------------\n" );
 }
 #endif /* __AVR__ */
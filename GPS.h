@@ -14,6 +14,9 @@
   * @author
   */
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define kTRUE   (1==1)
 #define kFALSE  (1==0)
 
@@ -21,7 +24,11 @@
 extern "C" {
 #endif /* __cplusplus */
 
-/** Enum to indicate the different GPS (NMEA) message types. */
+/** Enum to indicate the different GPS (NMEA) message types.
+  *
+  * The types don't depend on the talker, i.e. kGPRMC stands for $GPRMC as
+  * well as for $GNRMC, $GLRMC, $GARMC and $BDRMC.
+  */
 typedef enum {
 
   kNONE = 0,
@@ -31,7 +38,8 @@ typedef enum {
 
   kGPVTG = 3,
 
-  kGPGSA = 9    // detected, but not decoded
+  kGPGSA = 9,   // detected, but not decoded
+  kGPGSV = 10   // detected, but not decoded
 
 } EGPSSentenceType;
 
@@ -41,16 +49,53 @@ enum {
   kValid    = 0x80
 };
 
+/** The decoded data in binary fixed-point form.
+  *
+  * Each field is converted once, as soon as it has been received, thus the
+  * consumers may use integer math instead of parsing the strings again.
+  */
+typedef struct {
+
+  int32_t   fLatitude;                 // Latitude in 1e-7 degrees, north > 0
+  int32_t   fLongitude;                // Longitude in 1e-7 degrees, east > 0
+  int32_t   fAltitude;                 // Altitude in cm
+  uint32_t  fTime;                     // UTC time in ms of the day
+#ifndef APRS
+  uint32_t  fDate;                     // Date as number DDMMYY
+#endif /* APRS */
+  uint16_t  fSpeed;                    // Speed in 0.1 units of fSpeed below
+  uint16_t  fCourse;                   // Track angle in 0.01 degrees
+#ifndef APRS
+  uint16_t  fHDOP;                     // HDOP * 10
+#endif /* APRS */
+  uint8_t   fSatellites;               // Number of Satellites tracked
+
+} GpsFix_t;
+
+/** Bits of the fields of GpsData_t, see fChanged. */
+enum {
+  kFieldTime       = 0x0001,
+  kFieldDate       = 0x0002,
+  kFieldLatitude   = 0x0004,           // incl. fNorthSouth
+  kFieldLongitude  = 0x0008,           // incl. fEastWest
+  kFieldAltitude   = 0x0010,
+  kFieldSpeed      = 0x0020,
+  kFieldCourse     = 0x0040,
+  kFieldHDOP       = 0x0080,
+  kFieldSatellites = 0x0100,
+
+  kFieldAll        = 0x01ff
+};
+
 /** A structure filled with position and date/time data. */
 typedef struct {
 
   unsigned char  fStatus;              // Status bits to indicate ...
+  uint16_t       fChanged;             // kField* bits: changed since the
+                                       // fix before, set by the parser
 
-#if (defined GPS_NAVILOCK)
-  char  fTime[11];		       // UTC time in HHMMSS.sss format
-#else
-  char  fTime[7];		       // UTC time in HHMMSS format
-#endif // GPS_NAVILOCK
+  char  fTime[7];		       // UTC time in HHMMSS format, the
+                                       // milliseconds are in fFix.fTime
 #ifndef APRS
   char  fDate[7];                      // Date in DDMMYY format
 #endif /* APRS */
@@ -70,6 +115,8 @@ typedef struct {
 #endif /* APRS */
   char  fSatellites[3]; 	       // Number of Satellites tracked
 
+  GpsFix_t  fFix;                      // The same data in binary form
+
 } GpsData_t;
 
 /** Clear the status field of the GpsData_t struct. */
@@ -89,8 +136,197 @@ typedef struct {
 /** Check if GpsData_t struct contains valid data. */
 #define GpsDataIsValid(_gps_data) (((_gps_data)->fStatus & kValid) ? 1 : 0)
 
-/** To exchange the stable GPS data with other software modules. */
-extern GpsData_t gGpsData;
+/** States of the checksum verification in GpsParser_t. */
+enum {
+  kChecksumIdle = 0,   // outside of a sentence, waiting for '$'
+  kChecksumBody,       // summing up the characters between '$' and '*'
+  kChecksumDigit1,     // '*' seen, first hex digit expected
+  kChecksumDigit2,     // second hex digit expected
+  kChecksumDone,       // both hex digits read
+  kChecksumBad         // malformed checksum field
+};
+
+/** Flags of the epoch assembly in GpsParser_t. */
+enum {
+  kEpochDone = 0x01,   // the fix of the current epoch has been reported
+  kEpochLast = 0x02    // the sentence in fStage started the next epoch, it is
+                       // stored behind the fix (GpsParserUpdate())
+};
+
+/** Silence on the line (ms) after which an epoch counts as complete, see
+  * GpsParserTimeout().
+  */
+#define GPS_EPOCH_TIMEOUT  200
+
+/** Room for the decoded fields of a sentence in GpsParser_t, the ones of
+  * GPGGA up to the altitude: 45 characters and 8 commas.
+  */
+#define GPS_STAGE_SIZE  53
+
+/** Decoding state for one NMEA stream.
+  *
+  * Each stream (serial port, log file, ...) gets its own parser context,
+  * thus several streams may be decoded in parallel without any shared
+  * mutable state. The GpsMsg*() functions below work on a default context.
+  *
+  * The checksum of each sentence is verified while it is decoded. Its fields
+  * are staged in fStage meanwhile and only stored into fData when it is
+  * correct: a sentence with a wrong checksum - or one which is cut off - is
+  * simply dropped, so only verified sentences are ever published.
+  *
+  * The sentences of an epoch (a position solution of the receiver) are
+  * grouped by their UTC time field, a fix is only reported when the last
+  * of them arrived: its type is learned from the previous epoch. A time
+  * change (or a silence, GpsParserTimeout()) ends an epoch whose last
+  * sentence got lost.
+  */
+typedef struct {
+
+  unsigned char     fCommas;           // Number of commas so far in sentence
+  unsigned char     fIndex;            // Characters of the current field
+  EGPSSentenceType  fSentenceType;     // GPRMC, GPGGA, or unrecognized
+  char              fAddress[5];       // Address field, e.g. "GPRMC"
+#ifndef APRS
+  int16_t           fSpeed;            // Last accepted speed (-1: none yet)
+#endif /* APRS */
+  unsigned char     fChecksumState;    // kChecksumIdle, kChecksumBody, ...
+  unsigned char     fChecksum;         // XOR of the sentence body so far
+  unsigned char     fChecksumField;    // Value of the '*hh' field
+  uint16_t          fChanged;          // kField* bits changed since the
+                                       // last GpsParserPrepare()
+  unsigned int      fSentences;        // Number of sentences accepted
+  unsigned int      fRejected;         // Number of sentences dropped, ...
+  unsigned int      fChecksumErrors;   // ... of them for their checksum
+  uint32_t          fEpoch;            // UTC time of the current epoch (ms)
+  uint8_t           fEpochSeen;        // Sentence types received in it
+  uint8_t           fEpochType;        // ... the last one
+  uint8_t           fEpochEnd;         // Sentence type ending an epoch
+  uint8_t           fEpochFlags;       // kEpochDone, kEpochLast
+  GpsData_t         fData;             // Temporary data used for decoding
+  unsigned char     fStaged;           // Characters in fStage
+  char              fStage[GPS_STAGE_SIZE]; // Decoded fields of the current
+                                       // sentence, separated by ','
+
+} GpsParser_t;
+
+/** Initialize a parser context (fields blanked, no sentence pending). */
+extern void GpsParserInit(GpsParser_t *parser);
+
+/** Abort the sentence currently decoded, e.g. after a line error.
+  *
+  * The data of the sentence is dropped, see GpsParser_t.
+  */
+extern void GpsParserReset(GpsParser_t *parser);
+
+/** Feed the next character of the stream into the parser.
+  *
+  * Returns kTRUE if a sentence completed an epoch, i.e. the next fix may
+  * be taken by GpsParserPrepare().
+  */
+extern unsigned char GpsParserFeed(GpsParser_t *parser, unsigned char newchar);
+
+#if !(defined __AVR__)
+/** Called by GpsParserParse() for each completed epoch.
+  *
+  * 'offset' is the position in the buffer just behind the '\n' of the
+  * sentence completing it.
+  */
+typedef void (*GpsSentenceCallback_t)(GpsParser_t *parser, size_t offset,
+                                      void *arg);
+
+/** Feed a whole buffer into the parser, same result as GpsParserFeed().
+  *
+  * Returns the number of completed epochs.
+  */
+extern size_t GpsParserParse(GpsParser_t *parser, const char *buf, size_t len,
+                             GpsSentenceCallback_t callback, void *arg);
+#endif /* __AVR__ */
+
+/** Nothing was received for GPS_EPOCH_TIMEOUT ms: complete the current
+  * epoch, even if some of its sentences are missing.
+  *
+  * Returns kTRUE if this completed an epoch (once per epoch).
+  */
+extern unsigned char GpsParserTimeout(GpsParser_t *parser);
+
+/** Copy the decoded data of the parser into 'data' (see GpsMsgPrepare()). */
+extern void GpsParserPrepare(GpsParser_t *parser, GpsData_t *data);
+
+/** Like GpsParserPrepare(), but 'data' holds an earlier fix of the parser:
+  * only the fields changed since the last fix and those in 'stale' (the
+  * ones changed since 'data' was prepared) are copied.
+  */
+extern void GpsParserUpdate(GpsParser_t *parser, GpsData_t *data,
+                            uint16_t stale);
+
+#if !(defined __AVR__)
+/** Double buffered publication of decoded data.
+  *
+  * fBuffer[fSequence & 1] is the current fix, the writer prepares the next
+  * one in the other buffer and publishes it by incrementing fSequence. Thus
+  * a reader in another thread never sees a half written fix, see
+  * GpsSnapshotLoad().
+  */
+typedef struct {
+
+  GpsData_t         fBuffer[2];
+  volatile uint8_t  fSequence;         // Number of publications so far
+
+} GpsSnapshot_t;
+
+/** Buffer to be filled for the next publication. */
+#define GpsSnapshotBack(_snapshot) \
+  (&(_snapshot)->fBuffer[((_snapshot)->fSequence + 1) & 1])
+
+/** Make the back buffer the current fix. */
+extern void GpsSnapshotPublish(GpsSnapshot_t *snapshot);
+
+/** The current fix of gGpsSnapshot. */
+# define GpsSnapshotFront() (gGpsSnapshot.fBuffer[gGpsSnapshot.fSequence & 1])
+#else
+/** Publication of decoded data in the firmware: it reads gGpsData in the
+  * same context as it calls GpsMsgPrepare(), thus the fix is updated in
+  * place and a second buffer would only take RAM.
+  */
+typedef struct {
+
+  GpsData_t         fBuffer[1];
+
+} GpsSnapshot_t;
+
+/** Buffer to be filled for the next publication, the current fix. */
+# define GpsSnapshotBack(_snapshot)    (&(_snapshot)->fBuffer[0])
+
+/** Nothing to do, the fix has been updated in place. */
+# define GpsSnapshotPublish(_snapshot) ((void)(_snapshot))
+
+/** The current fix of gGpsSnapshot. */
+# define GpsSnapshotFront()            (gGpsSnapshot.fBuffer[0])
+#endif /* __AVR__ */
+
+#if !(defined __AVR__)
+/** Copy the current fix of 'snapshot' into 'out', never a torn one.
+  *
+  * Does not block the writer: if it published meanwhile the copy is
+  * repeated.
+  */
+extern void GpsSnapshotLoad(const GpsSnapshot_t *snapshot, GpsData_t *out);
+#endif /* __AVR__ */
+
+/** The stable GPS data, published by GpsMsgPrepare(). */
+extern GpsSnapshot_t gGpsSnapshot;
+
+/** To exchange the stable GPS data with other software modules.
+  *
+  * This is the current fix of gGpsSnapshot, for code running in the same
+  * context as GpsMsgPrepare(); concurrent readers use GpsSnapshotRead().
+  */
+#define gGpsData GpsSnapshotFront()
+
+#if !(defined __AVR__)
+/** Copy the current fix published by GpsMsgPrepare() into 'out'. */
+extern void GpsSnapshotRead(GpsData_t *out);
+#endif /* __AVR__ */
 
 /** Initialize some data structures of this software module. */
 extern void GpsMsgInit(void);
@@ -98,22 +334,81 @@ extern void GpsMsgInit(void);
 /** Convert the acquired GPS data to usable data (for APRS etc.). */
 extern void GpsMsgPrepare(void);
 
+#if !(defined __AVR__)
+/** Like GpsMsgPrepare(), but into 'data' instead of publishing it. */
+extern void GpsMsgPrepareData(GpsData_t *data);
+
+/** Publish 'data' of GpsMsgPrepareData() as the current fix.
+  *
+  * Thus decoding and consuming the fixes may run in different threads, the
+  * one calling GpsMsgPublish() owns gGpsData.
+  */
+extern void GpsMsgPublish(const GpsData_t *data);
+#endif /* __AVR__ */
+
 /** Handle incoming characters from GPS and parse them. */
 extern unsigned char GpsMsgHandler(unsigned char newchar);
 
+#if !(defined __AVR__)
+/** Handle a buffer of incoming characters, see GpsParserParse(). */
+extern size_t GpsMsgParseBuffer(const char *buf, size_t len,
+                                GpsSentenceCallback_t callback, void *arg);
+#endif /* __AVR__ */
+
+/** Timeout of the stream of GpsMsgHandler(), see GpsParserTimeout(). */
+extern unsigned char GpsMsgTimeout(void);
+
+/** Number of sentences dropped by GpsMsgHandler() so far. */
+extern unsigned int GpsMsgRejected(void);
+
+/** Range [fFrom, fTo) of a fixed-point input (gGpsData.fFix) within which a
+  * value derived from it stays the same, so it need not be calculated again.
+  * An empty range (fFrom == fTo) is never hit.
+  */
+typedef struct {
+
+  int32_t        fFrom;                // first input of the value
+  int32_t        fTo;                  // first input behind it
+
+} GpsCacheRange_t;
+
+/** Non-zero if 'value' is in the GpsCacheRange_t '*range'. */
+#define GpsCacheHit(range,value) \
+  ( (value) >= (range)->fFrom && (value) < (range)->fTo )
+
+/** Hit and miss counters of a cached derived value. */
+typedef struct {
+
+  unsigned int   fHits;                // value still valid
+  unsigned int   fMisses;              // value calculated
+
+} GpsCacheStats_t;
+
 /** Altitude (feet) in FFFFFF format */
 extern char gAltitudeFeet[];
 
-/** Convert the GPS altitude (usually in meters) into feet. */
+/** Counters of GpsCalculateFeet(). */
+extern GpsCacheStats_t gAltitudeFeetCache;
+
+/** Convert the GPS altitude (usually in meters) into feet.
+  *
+  * gAltitudeFeet is only written again when the altitude left the range
+  * of centimeters of the last foot.
+  */
 extern void GpsCalculateFeet(void);
 
 #ifndef APRS
 /** The Maidenhead locator calculated form latitude and longitude. */
 extern char gLocator[];
 
+/** Counters of GpsCalculateLocator(). */
+extern GpsCacheStats_t gLocatorCache;
+
 /** Calculate the Maidenhead grid locator from gGpsData.
   *
-  * The resulting, 6 characters long string is in gLocator.
+  * The resulting, 6 characters long string is in gLocator. It is only
+  * calculated again when the position left the subsquare (5' x 2.5') of the
+  * last one.
   */
 extern void GpsCalculateLocator(void);
 #endif /* APRS */
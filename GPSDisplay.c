@@ -50,6 +50,9 @@ enum {
 
 static volatile int8_t gGPSDataQuality = kNoSignal;
 
+/** Time since the last character from the GPS (10 ms ticks, see the ISR). */
+static volatile uint8_t gGPSSilence = 0;
+
 /* ------------------------------------------------------------------------- */
 
 /** Delay routine for delays in second regime. */
@@ -101,6 +104,26 @@ void SerialProcesses(void) {
 
 /* ------------------------------------------------------------------------- */
 
+/** Show the fix of an epoch just completed. */
+static void EpochDone(void)
+ {
+  GpsMsgPrepare();
+
+  if ( GpsDataIsComplete( &gGpsData ) && !GpsDataIsValid( &gGpsData ) )
+    gGPSDataQuality = kOldData;
+  else if ( GpsDataIsValid( &gGpsData ) )
+    gGPSDataQuality = kValidData;
+
+  if ( GpsDataIsComplete( &gGpsData ) ) {
+
+    LcdDisplayShow();
+
+    GpsDataClear( &gGpsData );
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
 /** Message handler function called by SerialProcesses() from Serial.c
   */
 void MsgHandler(unsigned char newchar)
@@ -115,23 +138,14 @@ void MsgHandler(unsigned char newchar)
   // just for testing ...
   LedGPSOn();
 
-  // end of NMEA sentence reached ?
-
-  if ( GpsMsgHandler( newchar ) == kTRUE ) {
+  gGPSSilence = 0;
 
-    GpsMsgPrepare();
+  // end of an epoch (all its NMEA sentences) reached ?
 
-    if ( GpsDataIsComplete( &gGpsData ) && !GpsDataIsValid( &gGpsData ) )
-      gGPSDataQuality = kOldData;
-    else if ( GpsDataIsValid( &gGpsData ) )
-      gGPSDataQuality = kValidData;
-
-    if ( GpsDataIsComplete( &gGpsData ) ) {
+  if ( GpsMsgHandler( newchar ) == kTRUE ) {
 
-      LcdDisplayShow();
+    EpochDone();
 
-      GpsDataClear( &gGpsData );
-    }
 //    // indicate somehow that we have no or old data
 //    else {
 //      //LedGPSOn();
@@ -229,6 +243,11 @@ int main(void)
 
     SerialProcesses();
 
+    /* the GPS is silent: the last sentences of an epoch got lost */
+
+    if ( gGPSSilence >= GPS_EPOCH_TIMEOUT / 10 && GpsMsgTimeout() == kTRUE )
+      EpochDone();
+
 #if 1
     /* display no signal message, if gGPSDataQuality == kNoSignal */
 
@@ -265,12 +284,15 @@ int main(void)
 
 // ISR for timer/counter 1: called every 10 ms
 // - load counter with initial constant
+// - count the time the GPS is silent
 // - call button check routine
 
 ISR(TIMER1_OVF_vect)
  {
   TCNT1 = CNT1_PRESET;
 
+  if ( gGPSSilence < 255 ) gGPSSilence++;
+
   // call button check routine
   CheckKeys();
 }
@@ -0,0 +1,296 @@
+/*
+ * File   : GPSIndex.c
+ *
+ * Purpose: Delimiter indexing of NMEA sentences (host only).
+ *
+ * $Id$
+ *
+ */
+
+
+#include <string.h>
+
+#if (defined __AVX2__) || (defined __SSE2__)
+# include <immintrin.h>
+#endif /* __AVX2__ || __SSE2__ */
+
+/** @file GPSIndex.c
+  * Finds the delimiters of a whole batch of NMEA sentences at once.
+  *
+  * The characters are classified in blocks of 64 into bit masks, the comma
+  * bits are then shifted into the comma mask of each sentence. Thus
+  * GpsParserParse() can extract the fields by lookup instead of counting
+  * commas character by character, and verify the checksum of a sentence
+  * with a few vector operations.
+  * @author
+  */
+
+#include "GPSIndex.h"
+
+/* ------------------------------------------------------------------------- */
+
+#if (defined __AVX2__)
+
+/** Characters equal to 'c' in the 32 characters 'v'. */
+# define GpsEqual(_v,_c) _mm256_cmpeq_epi8( (_v), _mm256_set1_epi8( (_c) ) )
+
+/** Bit mask of the characters selected by 'm' (32 of them). */
+# define GpsBits(_m)     ((uint64_t)(uint32_t)_mm256_movemask_epi8( (_m) ))
+
+/** Characters which start or end a sentence in the 32 characters 'v'. */
+# define GpsEvent(_v) \
+  _mm256_or_si256( _mm256_or_si256( GpsEqual( (_v), '$' ), GpsEqual( (_v), '\n' ) ), \
+                   GpsEqual( (_v), 0 ) )
+
+void GpsIndexBlock(const char *block, GpsBlockMask_t *mask)
+ {
+  const __m256i lo = _mm256_loadu_si256( (const __m256i *)block );
+  const __m256i hi = _mm256_loadu_si256( (const __m256i *)(block + 32) );
+
+  mask->fEvent = GpsBits( GpsEvent( lo ) )      | GpsBits( GpsEvent( hi ) ) << 32;
+  mask->fComma = GpsBits( GpsEqual( lo, ',' ) ) | GpsBits( GpsEqual( hi, ',' ) ) << 32;
+  mask->fStar  = GpsBits( GpsEqual( lo, '*' ) ) | GpsBits( GpsEqual( hi, '*' ) ) << 32;
+}
+
+#elif (defined __SSE2__)
+
+/** Characters equal to 'c' in the 16 characters 'v'. */
+# define GpsEqual(_v,_c) _mm_cmpeq_epi8( (_v), _mm_set1_epi8( (_c) ) )
+
+/** Bit mask of the characters selected by 'm' (16 of them). */
+# define GpsBits(_m)     ((uint64_t)(uint16_t)_mm_movemask_epi8( (_m) ))
+
+/** Characters which start or end a sentence in the 16 characters 'v'. */
+# define GpsEvent(_v) \
+  _mm_or_si128( _mm_or_si128( GpsEqual( (_v), '$' ), GpsEqual( (_v), '\n' ) ), \
+                GpsEqual( (_v), 0 ) )
+
+void GpsIndexBlock(const char *block, GpsBlockMask_t *mask)
+ {
+  mask->fEvent = mask->fComma = mask->fStar = 0;
+
+  for ( int i=0; i<4; i++ ) {
+
+    const __m128i v = _mm_loadu_si128( (const __m128i *)(block + 16 * i) );
+
+    mask->fEvent |= GpsBits( GpsEvent( v ) ) << (16 * i);
+    mask->fComma |= GpsBits( GpsEqual( v, ',' ) ) << (16 * i);
+    mask->fStar  |= GpsBits( GpsEqual( v, '*' ) ) << (16 * i);
+  }
+}
+
+#else
+
+void GpsIndexBlock(const char *block, GpsBlockMask_t *mask)
+ {
+  memset( mask, 0, sizeof(*mask) );
+
+  for ( int i=0; i<GPS_INDEX_BLOCK; i++ ) {
+
+    const uint64_t bit = (uint64_t)1 << i;
+
+    switch ( block[i] ) {
+      case '$':
+      case '\n':
+      case 0:    mask->fEvent |= bit; break;
+      case ',':  mask->fComma |= bit; break;
+      case '*':  mask->fStar  |= bit; break;
+    }
+  }
+}
+
+#endif /* __AVX2__ / __SSE2__ */
+
+/* ------------------------------------------------------------------------- */
+
+/** Bit mask of the bits 'from' ... 63. */
+#define GpsBitsFrom(_from) ((_from) < 64 ? ~(uint64_t)0 << (_from) : 0)
+
+size_t GpsIndexBuild(GpsIndex_t *index, const char *buf, size_t len)
+/*
+ * ABSTRACT:	Build the field offsets of all complete sentences in 'buf',
+ *		but not more than GPS_INDEX_MAX_SENTENCES.
+ *
+ *		A '$' restarts the current sentence, a '\0' drops it, as does
+ *		GpsParserFeed(). Sentences longer than 64k are not indexed.
+ *
+ *		Only these three characters are visited one by one, the
+ *		commas in between are shifted from the block's bit mask
+ *		into the one of the sentence.
+ *
+ * INPUT:	buf		Characters read from the stream
+ *		len		Number of characters in 'buf'
+ * OUTPUT:	index		Sentences found
+ * RETURN:	Number of characters covered by 'index'
+ */
+ {
+  GpsSentenceIndex_t *sentence = &index->fSentence[0];
+  unsigned char       active = 0;		// inside a sentence ?
+  char                tail[GPS_INDEX_BLOCK];
+
+  index->fCount = 0;
+
+  for ( size_t base = 0; base < len; base += GPS_INDEX_BLOCK ) {
+
+    const char     *block = buf + base;
+    GpsBlockMask_t  mask;
+    uint64_t        events;
+    unsigned int    from = 0;
+
+    if ( len - base < GPS_INDEX_BLOCK ) {	// last, partial block
+      memset( tail, ' ', sizeof(tail) );
+      memcpy( tail, block, len - base );
+      block = tail;
+    }
+
+    GpsIndexBlock( block, &mask );
+
+    if ( active && base + GPS_INDEX_BLOCK - sentence->fStart > 0xffff )
+      active = 0;				// too long for the offsets
+
+    events = mask.fEvent;
+
+    for (;;) {
+
+      const uint64_t     pending = events & GpsBitsFrom( from );
+      const unsigned int to = pending ? __builtin_ctzll( pending ) : 64;
+      const uint64_t     range = GpsBitsFrom( from ) & ~GpsBitsFrom( to );
+
+      if ( active ) {
+
+        const uint64_t commas = mask.fComma & range;
+        const size_t   shift = base + 64 - sentence->fStart;  // offset + 64 of
+                                                              // the block
+        if ( commas && shift < 64 )			// block of the '$'
+          sentence->fComma[0] |= commas >> (64 - shift);
+        else if ( commas && shift < 128 ) {
+          sentence->fComma[0] |= commas << (shift - 64);
+          if ( shift > 64 )
+            sentence->fComma[1] |= commas >> (128 - shift);
+        }
+        else if ( commas && shift < 192 )
+          sentence->fComma[1] |= commas << (shift - 128);
+
+        if ( !sentence->fStar && (mask.fStar & range) )
+          sentence->fStar =
+            base + __builtin_ctzll( mask.fStar & range ) - sentence->fStart;
+      }
+
+      if ( to == 64 ) break;			// continue with next block
+
+      from = to + 1;
+
+      switch ( block[to] ) {
+
+        case '$':				// (re)start a sentence
+          active = 1;
+          sentence->fStart  = base + to;
+          sentence->fStar   = 0;
+          sentence->fComma[0] = sentence->fComma[1] = 0;
+          break;
+
+        case '\n':				// sentence complete
+          if ( !active ) break;
+
+          active = 0;
+          sentence->fLength = base + to - sentence->fStart;
+
+          if ( ++index->fCount == GPS_INDEX_MAX_SENTENCES )
+            return base + to + 1;
+
+          sentence++;
+          break;
+
+        case 0:					// reset
+          active = 0;
+          break;
+      }
+    }
+  }
+
+  return len;
+
+} // End GpsIndexBuild(GpsIndex_t *index, const char *buf, size_t len)
+
+/* ------------------------------------------------------------------------- */
+
+uint8_t GpsIndexChecksum(const char *buf, size_t len)
+/*
+ * ABSTRACT:	XOR all characters of 'buf', a vector (or a 64 bit word) at
+ *		a time, the lanes are folded into one byte at the end.
+ *
+ * INPUT:	buf		Characters to sum up
+ *		len		Number of characters in 'buf'
+ * OUTPUT:	None
+ * RETURN:	The checksum
+ */
+ {
+  size_t   i = 0;
+  uint8_t  sum;
+
+#if (defined __AVX2__) || (defined __SSE2__)
+  __m128i  acc = _mm_setzero_si128();
+
+# if (defined __AVX2__)
+  if ( len >= 32 ) {
+
+    __m256i acc2 = _mm256_setzero_si256();
+
+    for ( ; i + 32 <= len; i += 32 )
+      acc2 = _mm256_xor_si256( acc2,
+                               _mm256_loadu_si256( (const __m256i *)(buf + i) ) );
+
+    acc = _mm_xor_si128( _mm256_castsi256_si128( acc2 ),
+                         _mm256_extracti128_si256( acc2, 1 ) );
+  }
+# endif /* __AVX2__ */
+
+  for ( ; i + 16 <= len; i += 16 )
+    acc = _mm_xor_si128( acc, _mm_loadu_si128( (const __m128i *)(buf + i) ) );
+
+  if ( i < len && len >= 16 ) {			// the remainder: last 16 characters,
+						// masked to the ones not summed yet
+    static const char kTail[32] = {
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+    };
+
+    acc = _mm_xor_si128( acc,
+            _mm_and_si128( _mm_loadu_si128( (const __m128i *)(buf + len - 16) ),
+                           _mm_loadu_si128( (const __m128i *)(kTail + len - i) ) ) );
+    i = len;
+  }
+
+  acc = _mm_xor_si128( acc, _mm_srli_si128( acc, 8 ) );
+  acc = _mm_xor_si128( acc, _mm_srli_si128( acc, 4 ) );
+  acc = _mm_xor_si128( acc, _mm_srli_si128( acc, 2 ) );
+  acc = _mm_xor_si128( acc, _mm_srli_si128( acc, 1 ) );
+
+  sum = (uint8_t)_mm_cvtsi128_si32( acc );
+#else
+  uint64_t acc = 0;
+
+  for ( ; i + 8 <= len; i += 8 ) {
+
+    uint64_t word;
+
+    memcpy( &word, buf + i, sizeof(word) );
+    acc ^= word;
+  }
+
+  acc ^= acc >> 32;
+  acc ^= acc >> 16;
+  acc ^= acc >> 8;
+
+  sum = (uint8_t)acc;
+#endif /* __AVX2__ || __SSE2__ */
+
+  for ( ; i < len; i++ )			// the remainder (of short ones)
+    sum ^= (uint8_t)buf[i];
+
+  return sum;
+
+} // End GpsIndexChecksum(const char *buf, size_t len)
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,133 @@
+/*
+ * File   : GPSIndex.h
+ *
+ * Purpose: Delimiter indexing of NMEA sentences (host only).
+ *
+ * $Id$
+ */
+
+#ifndef _GPSIndex_h_
+#define _GPSIndex_h_
+
+/** @file GPSIndex.h
+  * Declarations for file GPSIndex.c
+  * @author
+  */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Number of characters which are classified at once. */
+#define GPS_INDEX_BLOCK         64
+
+/** Maximum number of sentences in one GpsIndex_t batch. */
+#define GPS_INDEX_MAX_SENTENCES 64
+
+/** Maximum length of a sentence whose commas are recorded. */
+#define GPS_INDEX_MAX_LENGTH    128
+
+/** Delimiter positions of one block, bit i stands for character i. */
+typedef struct {
+
+  uint64_t  fEvent;                    // '$', '\n' and '\0', the characters
+                                       // which start or end a sentence (the
+                                       // '\r' belongs to the checksum)
+  uint64_t  fComma;                    // ','
+  uint64_t  fStar;                     // '*'
+
+} GpsBlockMask_t;
+
+/** Field offsets of one sentence.
+  *
+  * A sentence starts with '$', ends with '\n' and contains neither another
+  * '$' nor a '\0'. All offsets are relative to the '$', field k (k >= 1)
+  * consists of the characters between comma k-1 and comma k.
+  *
+  * The commas are kept as a bit mask (bit i: a comma at offset i), which is
+  * only complete for sentences shorter than GPS_INDEX_MAX_LENGTH.
+  */
+typedef struct {
+
+  size_t    fStart;                    // Offset of the '$' in the buffer
+  uint16_t  fLength;                   // Offset of the '\n'
+  uint16_t  fStar;                     // Offset of the first '*', 0 if none
+  uint64_t  fComma[GPS_INDEX_MAX_LENGTH / 64]; // Commas, see above
+
+} GpsSentenceIndex_t;
+
+/** A batch of indexed sentences. */
+typedef struct {
+
+  size_t              fCount;          // Number of sentences
+  GpsSentenceIndex_t  fSentence[GPS_INDEX_MAX_SENTENCES];
+
+} GpsIndex_t;
+
+/** Classify GPS_INDEX_BLOCK characters of 'block'.
+  *
+  * Uses AVX2 or SSE2 if the compiler targets it, plain C otherwise.
+  */
+extern void GpsIndexBlock(const char *block, GpsBlockMask_t *mask);
+
+/** Index the complete sentences at the start of 'buf'.
+  *
+  * Returns the number of characters covered by the index: the remaining
+  * characters are either part of an incomplete sentence or did not fit into
+  * this batch.
+  */
+extern size_t GpsIndexBuild(GpsIndex_t *index, const char *buf, size_t len);
+
+/** Offset of the first comma of 'sentence' at or behind 'from'.
+  *
+  * Returns GPS_INDEX_MAX_LENGTH if there is none.
+  */
+static inline unsigned int GpsIndexComma(const GpsSentenceIndex_t *sentence,
+                                         unsigned int from)
+ {
+  for ( unsigned int word = from / 64; word < GPS_INDEX_MAX_LENGTH / 64; word++ ) {
+
+    const uint64_t commas = sentence->fComma[word] &
+                            (~(uint64_t)0 << (from > word * 64 ? from % 64 : 0));
+
+    if ( commas )
+      return word * 64 + __builtin_ctzll( commas );
+  }
+
+  return GPS_INDEX_MAX_LENGTH;
+}
+
+/** Offsets of the first 'count' commas of 'sentence'.
+  *
+  * Returns the number of commas stored in 'comma', less than 'count' if the
+  * sentence has less.
+  */
+static inline unsigned int GpsIndexFields(const GpsSentenceIndex_t *sentence,
+                                          unsigned char *comma,
+                                          unsigned int count)
+ {
+  unsigned int n = 0;
+
+  for ( unsigned int word = 0; word < GPS_INDEX_MAX_LENGTH / 64; word++ )
+    for ( uint64_t commas = sentence->fComma[word]; commas; commas &= commas - 1 ) {
+      if ( n == count ) return n;
+      comma[n++] = word * 64 + __builtin_ctzll( commas );
+    }
+
+  return n;
+}
+
+/** XOR of the 'len' characters of 'buf', i.e. the NMEA checksum of them.
+  *
+  * Uses AVX2 or SSE2 if the compiler targets it, plain C otherwise.
+  */
+extern uint8_t GpsIndexChecksum(const char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _GPSIndex_h_ */
@@ -0,0 +1,432 @@
+/*
+ * File   : HostCapture.c
+ *
+ * Purpose: Raw serial capture files with per-chunk timestamps for the host
+ *          programs.
+ *
+ * $Id$
+ *
+ */
+
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** @file HostCapture.c
+  * Capture files keep the characters of serial ports as they were read,
+  * with the time of each read, so bursts, gaps and overruns can be replayed
+  * later (see gpssim -s). Writing is batched by HostLog, reading is done on
+  * a mapping of the file. The format is described in HostCapture.h.
+  * @author
+  */
+
+#include "HostCapture.h"
+
+/** File header as written by this version. */
+static const unsigned char gHostCaptureHeader[HOST_CAPTURE_HEADER] = {
+  0x89, 'G', 'P', 'S', 'C', 'A', 'P', '\n',
+  1, 0,  HOST_CAPTURE_RECORD, 0,  0, 0, 0, 0
+};
+
+/** Bit of the length field marking a meta record. */
+#define HOST_CAPTURE_META_BIT   0x8000
+
+/* ------------------------------------------------------------------------- */
+
+static void HostCapturePut(unsigned char *ptr, unsigned long long value,
+                           int bytes)
+ {
+  while ( bytes-- ) {
+    *ptr++ = (unsigned char)value;
+    value >>= 8;
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static unsigned long long HostCaptureGet(const unsigned char *ptr, int bytes)
+ {
+  unsigned long long value = 0;
+
+  while ( bytes-- )
+    value = value << 8 | ptr[bytes];
+
+  return value;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static long long HostCaptureNow(clockid_t clock)
+ {
+  struct timespec ts;
+
+  clock_gettime( clock, &ts );
+
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static size_t HostCaptureEnd(const unsigned char *data, size_t size)
+/*
+ * ABSTRACT:	Find the end of the last complete record.
+ *
+ * INPUT:	data		The file
+ *		size		Its size
+ * OUTPUT:	None
+ * RETURN:	Offset behind the last complete record
+ */
+ {
+  size_t pos = HOST_CAPTURE_HEADER;
+
+  while ( pos + HOST_CAPTURE_RECORD <= size ) {
+
+    const size_t len = HostCaptureGet( data + pos + 10, 2 )
+                       & ~HOST_CAPTURE_META_BIT;
+
+    if ( pos + HOST_CAPTURE_RECORD + len > size ) break;
+
+    pos += HOST_CAPTURE_RECORD + len;
+  }
+
+  return pos;
+
+} // End HostCaptureEnd(const unsigned char *data, size_t size)
+
+/* ------------------------------------------------------------------------- */
+
+static void HostCaptureRecord(HostCapture_t *cap, unsigned int port,
+                              long long time, int meta, const void *data,
+                              size_t len)
+/*
+ * ABSTRACT:	Append a record, a meta record if 'meta' is set.
+ *
+ * INPUT:	cap		The capture file
+ *		port		Port id
+ *		time		CLOCK_MONOTONIC, ns
+ *		meta		HOST_CAPTURE_* or 0 for data
+ *		data		Payload
+ *		len		Its length (at most HOST_CAPTURE_MAX_LEN - 1)
+ * OUTPUT:	cap		Record added
+ * RETURN:	None
+ */
+ {
+  unsigned char header[HOST_CAPTURE_RECORD + 1];
+  size_t        hlen = HOST_CAPTURE_RECORD;
+
+  HostCapturePut( header, time, 8 );
+  HostCapturePut( header + 8, port, 2 );
+
+  if ( meta ) {
+    HostCapturePut( header + 10, ( len + 1 ) | HOST_CAPTURE_META_BIT, 2 );
+    header[hlen++] = meta;
+  }
+  else
+    HostCapturePut( header + 10, len, 2 );
+
+  HostLogWrite( &cap->fLog, header, hlen );
+  HostLogWrite( &cap->fLog, data, len );
+
+  cap->fRecords++;
+
+} // End HostCaptureRecord(HostCapture_t *cap, unsigned int port, ...)
+
+/* ------------------------------------------------------------------------- */
+
+int HostCaptureOpen(HostCapture_t *cap, const char *path)
+/*
+ * ABSTRACT:	Check the file (if not new) and cut off a torn record at its
+ *		end, then open it for appending and start a session.
+ *
+ * INPUT:	cap		The capture file
+ *		path		Its name
+ * OUTPUT:	cap		Opened
+ * RETURN:	0 on success, -1 with errno set on error
+ */
+ {
+  cap->fLog.fFd = -1;
+  cap->fRecords = 0;
+  cap->fBytes = 0;
+
+  const int fd = open( path, O_RDWR | O_CREAT, 0644 );
+  struct stat st;
+
+  if ( fd < 0 ) return -1;
+
+  if ( fstat( fd, &st ) < 0 ) {
+    close( fd );
+    return -1;
+  }
+
+  if ( st.st_size == 0 ) {
+
+    if ( write( fd, gHostCaptureHeader, sizeof(gHostCaptureHeader) )
+         != sizeof(gHostCaptureHeader) ) {
+      close( fd );
+      return -1;
+    }
+  }
+  else {
+
+    const size_t size = st.st_size;
+    const unsigned char *data =
+      size < HOST_CAPTURE_HEADER ? MAP_FAILED :
+      (const unsigned char *)mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+
+    if ( data == MAP_FAILED ||
+         memcmp( data, gHostCaptureHeader, HOST_CAPTURE_HEADER ) ) {
+      if ( data != MAP_FAILED ) munmap( (void *)data, size );
+      close( fd );
+      errno = EINVAL;
+      return -1;
+    }
+
+    const size_t end = HostCaptureEnd( data, size );
+
+    munmap( (void *)data, size );
+
+    if ( end < size && ftruncate( fd, end ) < 0 ) {
+      close( fd );
+      return -1;
+    }
+  }
+
+  close( fd );
+
+  if ( HostLogOpen( &cap->fLog, path, 1 ) < 0 ) return -1;
+
+  unsigned char realtime[8];
+
+  HostCapturePut( realtime, HostCaptureNow( CLOCK_REALTIME ), 8 );
+
+  HostCaptureRecord( cap, 0, HostCaptureNow( CLOCK_MONOTONIC ),
+                     HOST_CAPTURE_SESSION, realtime, sizeof(realtime) );
+
+  return 0;
+
+} // End HostCaptureOpen(HostCapture_t *cap, const char *path)
+
+/* ------------------------------------------------------------------------- */
+
+void HostCapturePort(HostCapture_t *cap, unsigned int port, const char *name,
+                     unsigned long baud)
+ {
+  unsigned char info[4 + 256];
+  size_t        len = strlen( name );
+
+  if ( len > sizeof(info) - 4 ) len = sizeof(info) - 4;
+
+  HostCapturePut( info, baud, 4 );
+  memcpy( info + 4, name, len );
+
+  HostCaptureRecord( cap, port, HostCaptureNow( CLOCK_MONOTONIC ),
+                     HOST_CAPTURE_PORT, info, 4 + len );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostCaptureData(HostCapture_t *cap, unsigned int port, long long time,
+                     const void *data, size_t len)
+ {
+  const unsigned char *ptr = (const unsigned char *)data;
+
+  cap->fBytes += len;
+
+  while ( len ) {
+
+    const size_t n = len < HOST_CAPTURE_MAX_LEN ? len : HOST_CAPTURE_MAX_LEN;
+
+    HostCaptureRecord( cap, port, time, 0, ptr, n );
+
+    ptr += n;
+    len -= n;
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostCaptureLost(HostCapture_t *cap, unsigned int port, long long time,
+                     unsigned long count)
+ {
+  unsigned char lost[4];
+
+  HostCapturePut( lost, count, 4 );
+
+  HostCaptureRecord( cap, port, time, HOST_CAPTURE_LOST, lost, sizeof(lost) );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostCaptureClose(HostCapture_t *cap)
+ {
+  HostLogClose( &cap->fLog );
+}
+
+/* ------------------------------------------------------------------------- */
+
+int HostCaptureMap(HostCaptureReader_t *reader, const char *path)
+ {
+  const int fd = open( path, O_RDONLY );
+  struct stat st;
+
+  reader->fData = NULL;
+  reader->fSize = 0;
+  reader->fPos = HOST_CAPTURE_HEADER;
+
+  if ( fd < 0 ) return -1;
+
+  if ( fstat( fd, &st ) < 0 ) {
+    close( fd );
+    return -1;
+  }
+
+  if ( (size_t)st.st_size < HOST_CAPTURE_HEADER ) {
+    close( fd );
+    errno = EINVAL;
+    return -1;
+  }
+
+  const unsigned char *data =
+    (const unsigned char *)mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                                 fd, 0 );
+
+  close( fd );
+
+  if ( data == MAP_FAILED ) return -1;
+
+  if ( memcmp( data, gHostCaptureHeader, HOST_CAPTURE_HEADER ) ) {
+    munmap( (void *)data, st.st_size );
+    errno = EINVAL;
+    return -1;
+  }
+
+  madvise( (void *)data, st.st_size, MADV_SEQUENTIAL );
+
+  reader->fData = data;
+  reader->fSize = st.st_size;
+
+  return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int HostCaptureNext(HostCaptureReader_t *reader, HostCaptureRecord_t *record)
+/*
+ * ABSTRACT:	Decode the record at the current position and move behind
+ *		it. A torn record at the end of the file is no record.
+ *
+ * INPUT:	reader		The capture file
+ * OUTPUT:	reader		Position advanced
+ *		record		The record
+ * RETURN:	1 for a record, 0 at the end of the file
+ */
+ {
+  const unsigned char *ptr = reader->fData + reader->fPos;
+
+  if ( reader->fPos + HOST_CAPTURE_RECORD > reader->fSize ) return 0;
+
+  const size_t len = HostCaptureGet( ptr + 10, 2 );
+  const size_t payload = len & ~HOST_CAPTURE_META_BIT;
+
+  if ( reader->fPos + HOST_CAPTURE_RECORD + payload > reader->fSize ||
+       ( ( len & HOST_CAPTURE_META_BIT ) && !payload ) )
+    return 0;
+
+  record->fTime = (long long)HostCaptureGet( ptr, 8 );
+  record->fPort = HostCaptureGet( ptr + 8, 2 );
+  record->fData = ptr + HOST_CAPTURE_RECORD;
+  record->fLen = payload;
+  record->fMeta = 0;
+
+  if ( len & HOST_CAPTURE_META_BIT ) {
+    record->fMeta = *record->fData++;
+    record->fLen--;
+  }
+
+  reader->fPos += HOST_CAPTURE_RECORD + payload;
+
+  return 1;
+
+} // End HostCaptureNext(HostCaptureReader_t *reader, ...)
+
+/* ------------------------------------------------------------------------- */
+
+void HostCaptureSeek(HostCaptureReader_t *reader, long long realtime,
+                     HostCaptureRecord_t *session)
+/*
+ * ABSTRACT:	Go to the first record at or after 'realtime'. The time of a
+ *		record is its CLOCK_MONOTONIC time relative to the one of the
+ *		session record in front of it plus the session's real time,
+ *		as the monotonic clock starts anew with each session (records
+ *		in front of the first session record are taken as is).
+ *
+ *		The search is linear, from the first record of the file.
+ *
+ * INPUT:	reader		The capture file
+ *		realtime	CLOCK_REALTIME, ns
+ * OUTPUT:	reader		Positioned, at the end if there is no such
+ *				record
+ *		session		The session record in front of the position,
+ *				fMeta 0 if none or if the position is at a
+ *				session record (may be NULL)
+ * RETURN:	None
+ */
+ {
+  HostCaptureRecord_t record;
+  size_t              pos;
+  long long           session_mono = 0, session_real = 0;
+
+  HostCaptureRewind( reader );
+
+  if ( session ) session->fMeta = 0;
+
+  for ( pos = reader->fPos; HostCaptureNext( reader, &record );
+        pos = reader->fPos ) {
+
+    const int is_session = record.fMeta == HOST_CAPTURE_SESSION &&
+                           record.fLen >= 8;
+
+    if ( is_session ) {
+      session_mono = record.fTime;
+      session_real = (long long)HostCaptureGet( record.fData, 8 );
+    }
+
+    if ( session && is_session ) *session = record;
+
+    if ( session_real + record.fTime - session_mono >= realtime ) {
+      if ( session && is_session ) session->fMeta = 0;	// read next
+      break;
+    }
+  }
+
+  reader->fPos = pos;
+
+} // End HostCaptureSeek(HostCaptureReader_t *reader, long long realtime, ...)
+
+/* ------------------------------------------------------------------------- */
+
+void HostCaptureRewind(HostCaptureReader_t *reader)
+ {
+  reader->fPos = HOST_CAPTURE_HEADER;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostCaptureUnmap(HostCaptureReader_t *reader)
+ {
+  if ( reader->fData )
+    munmap( (void *)reader->fData, reader->fSize );
+
+  reader->fData = NULL;
+  reader->fSize = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,150 @@
+/*
+ * File   : HostCapture.h
+ *
+ * Purpose: Raw serial capture files with per-chunk timestamps for the host
+ *          programs.
+ *
+ * $Id$
+ */
+
+#ifndef _HostCapture_h_
+#define _HostCapture_h_
+
+/** @file HostCapture.h
+  * Declarations for file HostCapture.c
+  * @author
+  */
+
+#include <stddef.h>
+
+#include "HostLog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * File format, all numbers little endian:
+ *
+ *  file header (16 bytes):
+ *    8  magic "\211GPSCAP\n"
+ *    2  version (1)
+ *    2  size of a record header (12)
+ *    4  reserved (0)
+ *
+ *  records, one after the other until the end of the file:
+ *    8  CLOCK_MONOTONIC time, ns
+ *    2  port id
+ *    2  length of the payload, bit 15 set for a meta record
+ *    n  payload: the characters read, or for meta records a type byte
+ *       (HOST_CAPTURE_*) followed by its data
+ *
+ * A file is only ever appended to, a torn record at its end (crash) is cut
+ * off when it is opened again. Each program run starts with a session
+ * record, as the monotonic clock starts anew with each boot.
+ */
+
+/** Size of the file header. */
+#define HOST_CAPTURE_HEADER     16
+
+/** Size of a record header. */
+#define HOST_CAPTURE_RECORD     12
+
+/** Largest payload of a record, longer chunks are split. */
+#define HOST_CAPTURE_MAX_LEN    0x7fff
+
+/** Meta record: start of a session, 8 bytes CLOCK_REALTIME (ns). */
+#define HOST_CAPTURE_SESSION    1
+
+/** Meta record: a port, 4 bytes baud rate and its device name. */
+#define HOST_CAPTURE_PORT       2
+
+/** Meta record: characters lost by the port, 4 bytes count. */
+#define HOST_CAPTURE_LOST       3
+
+/** A capture file being written, batched by HostLog. */
+typedef struct {
+
+  HostLog_t      fLog;                 // the file
+  unsigned long  fRecords;             // records written
+  unsigned long long fBytes;           // characters captured
+
+} HostCapture_t;
+
+/** A record of a capture file, see HostCaptureNext(). */
+typedef struct {
+
+  long long      fTime;                // CLOCK_MONOTONIC, ns
+  unsigned int   fPort;                // port id
+  int            fMeta;                // HOST_CAPTURE_* or 0 for data
+  const unsigned char *fData;          // payload (without meta type byte)
+  size_t         fLen;                 // its length
+
+} HostCaptureRecord_t;
+
+/** A capture file being read, mapped into memory. */
+typedef struct {
+
+  const unsigned char *fData;          // the file
+  size_t         fSize;                // its size
+  size_t         fPos;                 // offset of the next record
+
+} HostCaptureReader_t;
+
+/** Open 'path' for appending (create it if needed) and start a session.
+  *
+  * Returns 0 on success, -1 with errno set on error, EINVAL if the file is
+  * no capture file.
+  */
+extern int HostCaptureOpen(HostCapture_t *cap, const char *path);
+
+/** Record port 'port': its device name and baud rate. */
+extern void HostCapturePort(HostCapture_t *cap, unsigned int port,
+                            const char *name, unsigned long baud);
+
+/** Record 'len' characters read from 'port' at 'time' (CLOCK_MONOTONIC). */
+extern void HostCaptureData(HostCapture_t *cap, unsigned int port,
+                            long long time, const void *data, size_t len);
+
+/** Record that 'count' characters of 'port' were lost at 'time'. */
+extern void HostCaptureLost(HostCapture_t *cap, unsigned int port,
+                            long long time, unsigned long count);
+
+/** Flush and close the file. */
+extern void HostCaptureClose(HostCapture_t *cap);
+
+/** Map 'path' for reading.
+  *
+  * Returns 0 on success, -1 with errno set on error, EINVAL if the file is
+  * no capture file.
+  */
+extern int HostCaptureMap(HostCaptureReader_t *reader, const char *path);
+
+/** Get the next record, returns 0 at the end of the file. */
+extern int HostCaptureNext(HostCaptureReader_t *reader,
+                           HostCaptureRecord_t *record);
+
+/** Go to the first record at or after 'realtime' (CLOCK_REALTIME, ns).
+  *
+  * The real time of a record is taken from the session record in front of
+  * it, so files with several sessions are searched correctly. The search
+  * is linear from the beginning of the file, only the record headers and
+  * the session records are looked at.
+  *
+  * 'session' (if not NULL) gets the session record the position is in,
+  * its fMeta is 0 if there is none or if it is the record at the position.
+  */
+extern void HostCaptureSeek(HostCaptureReader_t *reader, long long realtime,
+                            HostCaptureRecord_t *session);
+
+/** Go back to the first record. */
+extern void HostCaptureRewind(HostCaptureReader_t *reader);
+
+/** Unmap the file. */
+extern void HostCaptureUnmap(HostCaptureReader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _HostCapture_h_ */
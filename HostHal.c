@@ -0,0 +1,411 @@
+/*
+ * File   : HostHal.c
+ *
+ * Purpose: Hardware of the GPSDisplay firmware simulated on the host.
+ *
+ * $Id$
+ *
+ */
+
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @file HostHal.c
+  * Runs the unmodified firmware (GPSDisplay.c, Serial.c, get8key4.c,
+  * LCDDisplay.c, GPS.c) as a Linux program. The AVR headers are replaced by
+  * those in host/, the LCD library by HostLCD.c and the hardware by this
+  * file: the USART reads a serial port, pty or file, timer 1 and the button
+  * are driven by a simulated clock.
+  *
+  * The clock advances only when the firmware is known to spend time: in
+  * _delay_ms(), waiting for the LCD, or idle in the main loop until the next
+  * character arrives. Characters of a file arrive back to back at the baud
+  * rate, so the firmware runs at full speed but sees the line timing of the
+  * real receiver. Interrupts are delivered between two passes of the main
+  * loop; bytes received while the LCD was busy thus arrive in a burst, as
+  * they would be waiting in the RX buffer on the AVR.
+  *
+  * The main loop calls HostHalProcesses() instead of SerialProcesses() and
+  * main() of the firmware is GPSDisplayMain(), both renamed by the build
+  * (see SConscript).
+  * @author
+  */
+
+#include "global.h"
+
+#include <avr/interrupt.h>
+
+#include "Serial.h"
+#include "HostHal.h"
+#include "HostLCD.h"
+#include "HostLog.h"
+#include "HostSerial.h"
+
+extern int GPSDisplayMain(void);
+
+/** How long a button press (-k) lasts. */
+#define HOST_HAL_KEY_HOLD    100000000ULL      // ns
+
+/** Maximum number of button presses. */
+#define HOST_HAL_KEYS        64
+
+/** Period of the timer 1 overflow: CNT1_PRESET counts at F_CPU/1024. */
+#define HOST_HAL_TICK        ( (0x10000ULL - CNT1_PRESET) * 1024ULL \
+                               * 1000000000ULL / F_CPU )
+
+/** Longest idle wait for characters from a serial port or pty. */
+#define HOST_HAL_IDLE        10                // ms
+
+// --- the registers of host/avr/io.h
+
+volatile uint8_t  SREG;
+
+volatile uint8_t  DDRB, PORTB, PINB = 0xff;
+volatile uint8_t  DDRC, PORTC, PINC = 0xff;
+volatile uint8_t  DDRD, PORTD, PIND = 0xff;
+
+volatile uint16_t UDR = HOST_UDR_EMPTY;
+volatile uint8_t  UCSRA = (1<<UDRE), UCSRB, UCSRC, UBRRH, UBRRL;
+
+volatile uint16_t TCNT1;
+volatile uint8_t  TCCR1A, TCCR1B, TIMSK;
+
+// --- state of the simulated hardware
+
+static struct {
+
+  int                 fFd;                 // the USART's line
+  unsigned long long  fClock;              // simulated time, ns
+  unsigned long long  fByteTime;           // ns per character (8N1)
+  unsigned long long  fNextRx;             // arrival of the next character
+  unsigned long long  fNextTick;           // next timer 1 overflow
+  int                 fTickPending;        // overflow while interrupts off
+  int                 fStarted;            // main loop reached
+  int                 fIdle;               // waited for input
+  int                 fQuiet;              // don't print the LCD
+  char                fRx[4096];           // characters read, not received
+  size_t              fRxLen, fRxPos;
+  unsigned long long  fKeys[HOST_HAL_KEYS];  // button press times, ns
+  int                 fNumKeys;
+  HostLog_t           fTx;                 // characters sent (-t)
+
+  unsigned long       fRxBytes;            // statistics
+  unsigned long       fTxBytes;
+  unsigned long       fTicks;
+  unsigned long       fPasses;
+  unsigned long       fUpdates;
+
+} gHal;
+
+/* ------------------------------------------------------------------------- */
+
+static void HostHalTimer(void)
+/*
+ * ABSTRACT:	Deliver the timer 1 overflows which became due. While
+ *		interrupts are disabled, only the overflow flag remains.
+ *
+ * INPUT:	None
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  const int running = ( TCCR1B & ((1<<CS12)|(1<<CS11)|(1<<CS10)) ) &&
+                      ( TIMSK & (1<<TOIE1) );
+
+  if ( !running ) {
+    gHal.fNextTick = gHal.fClock + HOST_HAL_TICK;
+    return;
+  }
+
+  while ( gHal.fNextTick <= gHal.fClock ) {
+
+    gHal.fNextTick += HOST_HAL_TICK;
+
+    // the button is pressed (pin low) within HOST_HAL_KEY_HOLD of a press
+    PIND |= BUTTON1;
+    for ( int i=0; i<gHal.fNumKeys; i++ )
+      if ( gHal.fKeys[i] <= gHal.fNextTick &&
+           gHal.fNextTick < gHal.fKeys[i] + HOST_HAL_KEY_HOLD )
+        PIND &= ~BUTTON1;
+
+    gHal.fTickPending = 1;
+
+    if ( SREG & (1<<SREG_I) ) {
+      gHal.fTickPending = 0;
+      gHal.fTicks++;
+      TIMER1_OVF_vect();
+    }
+  }
+
+  if ( gHal.fTickPending && (SREG & (1<<SREG_I)) ) {
+    gHal.fTickPending = 0;
+    gHal.fTicks++;
+    TIMER1_OVF_vect();
+  }
+
+} // End HostHalTimer(void)
+
+/* ------------------------------------------------------------------------- */
+
+void HostHalDelay(unsigned long us)
+ {
+  gHal.fClock += us * 1000ULL;
+
+  HostHalTimer();
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void HostHalTransmit(void)
+/*
+ * ABSTRACT:	Take the characters the firmware wrote to UDR, each one
+ *		completes at once and raises the TX complete interrupt.
+ *
+ * INPUT:	None
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  while ( UDR != HOST_UDR_EMPTY ) {
+
+    const char c = (char)UDR;
+
+    UDR = HOST_UDR_EMPTY;
+    gHal.fTxBytes++;
+    HostLogWrite( &gHal.fTx, &c, 1 );
+
+    if ( !(UCSRB & (1<<TXCIE)) || !(SREG & (1<<SREG_I)) ) break;
+
+    USART_TXC_vect();
+  }
+
+} // End HostHalTransmit(void)
+
+/* ------------------------------------------------------------------------- */
+
+static unsigned long long HostHalRealTime(void)
+ {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void HostHalReceive(void)
+/*
+ * ABSTRACT:	Deliver the characters which arrived up to now. If none did,
+ *		the CPU is idle until the next one: advance the clock to it,
+ *		or wait for the port (in real time) if nothing was read yet.
+ *
+ * INPUT:	None
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  int received = 0;
+
+  if ( !(UCSRB & (1<<RXEN)) || !(UCSRB & (1<<RXCIE)) ||
+       !(SREG & (1<<SREG_I)) )
+    return;
+
+  for (;;) {
+
+    if ( gHal.fRxPos == gHal.fRxLen ) {
+
+      const ssize_t n = HostSerialRead( gHal.fFd, gHal.fRx, sizeof(gHal.fRx) );
+
+      if ( n < 0 ) exit( errno ? EXIT_FAILURE : EXIT_SUCCESS );
+
+      if ( n == 0 ) {
+
+        if ( received ) return;
+
+        struct pollfd pfd;
+        const unsigned long long start = HostHalRealTime();
+
+        pfd.fd = gHal.fFd;
+        pfd.events = POLLIN;
+        poll( &pfd, 1, HOST_HAL_IDLE );
+
+        gHal.fClock += HostHalRealTime() - start;
+        gHal.fIdle = 1;
+        HostHalTimer();
+        return;
+      }
+
+      gHal.fRxPos = 0;
+      gHal.fRxLen = n;
+
+      if ( gHal.fIdle && gHal.fNextRx < gHal.fClock )
+        gHal.fNextRx = gHal.fClock;          // the line was quiet
+      gHal.fIdle = 0;
+    }
+
+    if ( gHal.fNextRx > gHal.fClock ) {
+
+      if ( received ) return;
+
+      gHal.fClock = gHal.fNextRx;            // idle until it arrives
+      HostHalTimer();
+    }
+
+    UDR = (unsigned char)gHal.fRx[gHal.fRxPos++];
+    USART_RXC_vect();
+    UDR = HOST_UDR_EMPTY;
+
+    gHal.fNextRx += gHal.fByteTime;
+    gHal.fRxBytes++;
+    received = 1;
+  }
+
+} // End HostHalReceive(void)
+
+/* ------------------------------------------------------------------------- */
+
+static void HostHalShow(void)
+ {
+  char line0[16], line1[16];
+
+  HostLcdLine( 0, line0 );
+  HostLcdLine( 1, line1 );
+
+  printf( "%10.3f '%.16s' '%.16s'\n",
+          gHal.fClock / 1e9, line0, line1 );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostHalProcesses(void)
+ {
+  if ( !gHal.fStarted ) {                    // the GPS starts to send now
+    gHal.fStarted = 1;
+    gHal.fNextRx = gHal.fClock;
+  }
+
+  gHal.fPasses++;
+
+  HostHalTransmit();
+  HostHalTimer();
+  HostHalReceive();
+
+  SerialProcesses();
+
+  if ( gHostLcd.fChanged ) {
+    gHostLcd.fChanged = 0;
+    gHal.fUpdates++;
+    if ( !gHal.fQuiet ) HostHalShow();
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void HostHalReport(void)
+ {
+  HostLogClose( &gHal.fTx );
+
+  if ( gHal.fQuiet ) HostHalShow();
+  fflush( stdout );
+
+  fprintf( stderr,
+           "time %.3f s, %lu characters received, %lu lost, %lu sent\n"
+           "%lu passes of the main loop, %lu timer ticks\n"
+           "LCD: %lu updates, %lu instructions, %lu data writes, "
+           "busy %.3f s\n",
+           gHal.fClock / 1e9, gHal.fRxBytes, (unsigned long)SerialRxOverruns(),
+           gHal.fTxBytes, gHal.fPasses, gHal.fTicks, gHal.fUpdates,
+           gHostLcd.fCommands, gHostLcd.fData, gHostLcd.fBusy / 1e6 );
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void Usage(const char *pname)
+ {
+  fprintf( stderr,
+           "Usage: %s [-b <baud>] [-k <ms>[,<ms>...]] [-q] [-t <txfile>] "
+           "<device|nmea-file>\n\n", pname );
+  fprintf( stderr,
+           "  -k  press the button at these times (simulated ms)\n"
+           "  -q  print the LCD at the end only, not each change\n"
+           "  -t  save the characters the firmware sends\n\n" );
+  fprintf( stderr, "Example: %s -k 20000,30000 Data/navilock.dat\n", pname );
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+ {
+  unsigned long  baud = UART_BAUD_RATE;
+  const char    *txfile = NULL;
+  int            getopt_status;
+
+  do {
+
+    getopt_status = getopt( argc, argv, "b:k:qt:?" );
+
+    if ( getopt_status == EOF ) break;
+
+    switch ( getopt_status ) {
+
+      case 'b': baud = strtoul( optarg, NULL, 10 );
+                break;
+
+      case 'k': for ( char *s = optarg; *s && gHal.fNumKeys < HOST_HAL_KEYS; ) {
+                  gHal.fKeys[gHal.fNumKeys++] =
+                    strtoull( s, &s, 10 ) * 1000000ULL;
+                  if ( *s == ',' ) s++;
+                  else break;
+                }
+                break;
+
+      case 'q': gHal.fQuiet = 1;
+                break;
+
+      case 't': txfile = optarg;
+                break;
+
+      case '?': Usage( argv[0] );
+                exit( EXIT_FAILURE );
+                break;
+    }
+
+  } while ( getopt_status != EOF );
+
+  if ( optind >= argc || !baud ) {
+    Usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  gHal.fFd = HostSerialOpen( argv[optind], baud, O_RDONLY );
+  if ( gHal.fFd < 0 ) {
+    fprintf( stderr, "%s: could not open %s: %s\n",
+             argv[0], argv[optind], strerror( errno ) );
+    exit( EXIT_FAILURE );
+  }
+
+  gHal.fTx.fFd = -1;
+  if ( txfile && HostLogOpen( &gHal.fTx, txfile, 0 ) < 0 ) {
+    fprintf( stderr, "%s: could not open %s: %s\n",
+             argv[0], txfile, strerror( errno ) );
+    exit( EXIT_FAILURE );
+  }
+
+  gHal.fByteTime = 10 * 1000000000ULL / baud;  // start, 8 data, stop bit
+
+  atexit( HostHalReport );
+
+  return GPSDisplayMain();
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------------------------------------------------- */
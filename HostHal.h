@@ -0,0 +1,40 @@
+/*
+ * File   : HostHal.h
+ *
+ * Purpose: Hardware of the GPSDisplay firmware simulated on the host.
+ *
+ * $Id$
+ */
+
+#ifndef _HostHal_h_
+#define _HostHal_h_
+
+/** @file HostHal.h
+  * Declarations for file HostHal.c
+  * @author
+  */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Let 'us' microseconds of the simulated clock pass (CPU busy).
+  *
+  * The timer interrupt is delivered if it became due and interrupts are
+  * enabled; characters arriving meanwhile wait for HostHalProcesses().
+  */
+extern void HostHalDelay(unsigned long us);
+
+/** Called instead of SerialProcesses() by the firmware's main loop.
+  *
+  * Runs the simulated hardware - the USART and the timer interrupts that
+  * became due - and then SerialProcesses(). If the CPU would be idle, the
+  * clock advances to the next received character. Exits at end of input.
+  */
+extern void HostHalProcesses(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _HostHal_h_ */
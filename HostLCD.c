@@ -0,0 +1,210 @@
+/*
+ * File   : HostLCD.c
+ *
+ * Purpose: HD44780 2x16 LCD model behind lcd.h for the host.
+ *
+ * $Id$
+ *
+ */
+
+
+#include <string.h>
+
+/** @file HostLCD.c
+  * The functions of P.Fleury's LCD library (lcd.h) for the firmware built
+  * on the host: they write to a model of the HD44780 display data RAM and
+  * charge the execution time of each instruction to the simulated clock,
+  * the firmware stalls the same way as waiting for the busy flag.
+  * @author
+  */
+
+#include "lcd.h"
+
+#include "HostHal.h"
+#include "HostLCD.h"
+
+/** Execution times of the HD44780 (plus some overhead of the library). */
+#define HOST_LCD_CMD_TIME    40        // us, most instructions and data
+#define HOST_LCD_CLEAR_TIME  1640      // us, clear display / return home
+
+/** End (exclusive) of the first line in the DDRAM, 40 characters per line. */
+#define HOST_LCD_LINE1_END   0x28
+
+HostLcd_t gHostLcd;
+
+/* ------------------------------------------------------------------------- */
+
+static void HostLcdBusy(unsigned long us)
+ {
+  gHostLcd.fBusy += us;
+  HostHalDelay( us );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void lcd_command(uint8_t cmd)
+/*
+ * ABSTRACT:	Execute an instruction. Only DDRAM addressing, clear and home
+ *		change the model, the others are counted only.
+ *
+ * INPUT:	cmd		Instruction, see HD44780 data sheet
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  gHostLcd.fCommands++;
+
+  if ( cmd & (1<<LCD_DDRAM) ) {
+    gHostLcd.fAddress = cmd & 0x7f;
+  }
+  else if ( cmd & (1<<LCD_CGRAM) ) {
+    // no user defined characters
+  }
+  else if ( cmd & ((1<<LCD_FUNCTION) | (1<<LCD_MOVE)) ) {
+    // nothing to do
+  }
+  else if ( cmd & (1<<LCD_ON) ) {
+    gHostLcd.fControl = cmd;
+  }
+  else if ( cmd & (1<<LCD_ENTRY_MODE) ) {
+    // always increment, no shift
+  }
+  else if ( cmd & (1<<LCD_HOME) ) {
+    gHostLcd.fAddress = 0;
+    HostLcdBusy( HOST_LCD_CLEAR_TIME );
+    return;
+  }
+  else if ( cmd & (1<<LCD_CLR) ) {
+    memset( gHostLcd.fDDRAM, ' ', sizeof(gHostLcd.fDDRAM) );
+    gHostLcd.fAddress = 0;
+    gHostLcd.fChanged = 1;
+    HostLcdBusy( HOST_LCD_CLEAR_TIME );
+    return;
+  }
+
+  HostLcdBusy( HOST_LCD_CMD_TIME );
+
+} // End lcd_command(uint8_t cmd)
+
+/* ------------------------------------------------------------------------- */
+
+void lcd_data(uint8_t data)
+/*
+ * ABSTRACT:	Write to the DDRAM and advance the address counter, which
+ *		runs from the end of one line to the start of the other.
+ *
+ * INPUT:	data		Character code
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  uint8_t address = gHostLcd.fAddress;
+
+  gHostLcd.fData++;
+
+  if ( address < HOST_LCD_DDRAM ) {
+    if ( gHostLcd.fDDRAM[address] != data ) gHostLcd.fChanged = 1;
+    gHostLcd.fDDRAM[address] = data;
+  }
+
+  if ( ++address == HOST_LCD_LINE1_END )
+    address = LCD_START_LINE2;
+  else if ( address >= HOST_LCD_DDRAM )
+    address = LCD_START_LINE1;
+  gHostLcd.fAddress = address;
+
+  HostLcdBusy( HOST_LCD_CMD_TIME );
+
+} // End lcd_data(uint8_t data)
+
+/* ------------------------------------------------------------------------- */
+
+void lcd_init(uint8_t dispAttr)
+ {
+  lcd_command( (1<<LCD_FUNCTION) | (1<<LCD_FUNCTION_2LINES) );
+  lcd_command( LCD_DISP_OFF );
+  lcd_clrscr();
+  lcd_command( LCD_MODE_DEFAULT );
+  lcd_command( dispAttr );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void lcd_clrscr(void)
+ {
+  lcd_command( 1<<LCD_CLR );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void lcd_home(void)
+ {
+  lcd_command( 1<<LCD_HOME );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void lcd_gotoxy(uint8_t x, uint8_t y)
+ {
+  if ( y == 0 )
+    lcd_command( (1<<LCD_DDRAM) + LCD_START_LINE1 + x );
+  else
+    lcd_command( (1<<LCD_DDRAM) + LCD_START_LINE2 + x );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void lcd_putc(char c)
+/*
+ * ABSTRACT:	Display a character, '\n' moves to the start of the other
+ *		line (no automatic wrap, LCD_WRAP_LINES is 0).
+ *
+ * INPUT:	c		Character
+ * OUTPUT:	None
+ * RETURN:	None
+ */
+ {
+  if ( c == '\n' )
+    lcd_gotoxy( 0, gHostLcd.fAddress < LCD_START_LINE2 ? 1 : 0 );
+  else
+    lcd_data( (uint8_t)c );
+
+} // End lcd_putc(char c)
+
+/* ------------------------------------------------------------------------- */
+
+void lcd_puts(const char *s)
+ {
+  while ( *s )
+    lcd_putc( *s++ );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void lcd_puts_p(const char *progmem_s)
+ {
+  lcd_puts( progmem_s );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostLcdLine(uint8_t line, char *buf)
+ {
+  const uint8_t *ddram =
+    gHostLcd.fDDRAM + ( line == 0 ? LCD_START_LINE1 : LCD_START_LINE2 );
+
+  for ( int i=0; i<LCD_DISP_LENGTH; i++ ) {
+
+    const uint8_t c = ddram[i];
+
+    if ( c == 0xdf )                       // HD44780 ROM A00: degree sign
+      buf[i] = (char)0xb0;                 // ... in Latin-1
+    else if ( c < ' ' || c > '~' )
+      buf[i] = '?';
+    else
+      buf[i] = (char)c;
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,50 @@
+/*
+ * File   : HostLCD.h
+ *
+ * Purpose: HD44780 2x16 LCD model behind lcd.h for the host.
+ *
+ * $Id$
+ */
+
+#ifndef _HostLCD_h_
+#define _HostLCD_h_
+
+/** @file HostLCD.h
+  * Declarations for file HostLCD.c
+  * @author
+  */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Size of the display data RAM, line 2 starts at 0x40. */
+#define HOST_LCD_DDRAM   0x68
+
+/** State of the LCD controller. */
+typedef struct {
+
+  uint8_t        fDDRAM[HOST_LCD_DDRAM];  // display data
+  uint8_t        fAddress;                // address counter
+  uint8_t        fControl;                // last display on/off control
+  uint8_t        fChanged;                // DDRAM written since last look
+  unsigned long  fCommands;               // number of instructions
+  unsigned long  fData;                   // number of data writes
+  unsigned long  fBusy;                   // time spent on both, us
+
+} HostLcd_t;
+
+extern HostLcd_t gHostLcd;
+
+/** Copy the visible characters of 'line' (0, 1) to 'buf' (16 characters,
+  * not terminated) in Latin-1, like the host tools print them.
+  */
+extern void HostLcdLine(uint8_t line, char *buf);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _HostLCD_h_ */
@@ -0,0 +1,180 @@
+/*
+ * File   : HostLog.c
+ *
+ * Purpose: Batched (group commit) output files for the host programs.
+ *
+ * $Id$
+ *
+ */
+
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/** @file HostLog.c
+  * Output files which are written in batches: logging every sentence with
+  * its own write() (and fflush()) costs a system call per line, which does
+  * not keep up with several receivers at 10 Hz.
+  * @author
+  */
+
+#include "HostLog.h"
+
+/* ------------------------------------------------------------------------- */
+
+static long long HostLogNow(void)
+ {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void HostLogWritev(HostLog_t *log, struct iovec *iov, int iovcnt)
+/*
+ * ABSTRACT:	Write all of 'iov', continuing after partial writes.
+ *
+ * INPUT:	log		The output file
+ *		iov		Data to write
+ *		iovcnt		Number of entries in 'iov'
+ * OUTPUT:	log		Statistics updated
+ * RETURN:	None
+ */
+ {
+  while ( iovcnt > 0 ) {
+
+    ssize_t n = writev( log->fFd, iov, iovcnt );
+
+    if ( n < 0 ) {
+      if ( errno == EINTR ) continue;
+      log->fErrors++;
+      return;
+    }
+
+    log->fWrites++;
+
+    while ( iovcnt > 0 && (size_t)n >= iov->iov_len ) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+
+    if ( iovcnt > 0 ) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+
+} // End HostLogWritev(HostLog_t *log, struct iovec *iov, int iovcnt)
+
+/* ------------------------------------------------------------------------- */
+
+int HostLogOpen(HostLog_t *log, const char *path, int append)
+ {
+  log->fFd = open( path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC),
+                   0644 );
+  log->fFlushSize = HOST_LOG_FLUSH_SIZE;
+  log->fFlushDelay = HOST_LOG_FLUSH_DELAY;
+  log->fUsed = 0;
+  log->fOldest = 0;
+  log->fWrites = 0;
+  log->fErrors = 0;
+
+  return log->fFd < 0 ? -1 : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostLogWrite(HostLog_t *log, const void *data, size_t len)
+/*
+ * ABSTRACT:	Append to the batch. If the data doesn't fit, the batch and
+ *		the data are written together by a single writev().
+ *
+ * INPUT:	log		The output file
+ *		data		Data to write
+ *		len		Number of bytes in 'data'
+ * OUTPUT:	log		Data added or written
+ * RETURN:	None
+ */
+ {
+  if ( log->fFd < 0 || !len ) return;
+
+  if ( log->fUsed + len > sizeof(log->fBuffer) ) {
+
+    struct iovec iov[2];
+
+    iov[0].iov_base = log->fBuffer;
+    iov[0].iov_len = log->fUsed;
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = len;
+
+    HostLogWritev( log, iov, 2 );
+    log->fUsed = 0;
+    return;
+  }
+
+  if ( !log->fUsed ) log->fOldest = HostLogNow();
+
+  memcpy( log->fBuffer + log->fUsed, data, len );
+  log->fUsed += len;
+
+  if ( log->fUsed >= log->fFlushSize )
+    HostLogFlush( log );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostLogFlush(HostLog_t *log)
+ {
+  struct iovec iov;
+
+  if ( log->fFd < 0 || !log->fUsed ) return;
+
+  iov.iov_base = log->fBuffer;
+  iov.iov_len = log->fUsed;
+
+  HostLogWritev( log, &iov, 1 );
+  log->fUsed = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int HostLogTimeout(const HostLog_t *log)
+ {
+  if ( log->fFd < 0 || !log->fUsed ) return -1;
+
+  const long long left = log->fOldest + log->fFlushDelay - HostLogNow();
+
+  return left > 0 ? (int)left : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostLogTick(HostLog_t *log)
+ {
+  if ( HostLogTimeout( log ) == 0 )
+    HostLogFlush( log );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HostLogClose(HostLog_t *log)
+ {
+  if ( log->fFd < 0 ) return;
+
+  HostLogFlush( log );
+  close( log->fFd );
+  log->fFd = -1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------------------------------------------------- */
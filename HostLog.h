@@ -0,0 +1,77 @@
+/*
+ * File   : HostLog.h
+ *
+ * Purpose: Batched (group commit) output files for the host programs.
+ *
+ * $Id$
+ */
+
+#ifndef _HostLog_h_
+#define _HostLog_h_
+
+/** @file HostLog.h
+  * Declarations for file HostLog.c
+  * @author
+  */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Size of the buffer collecting the data of one write. */
+#define HOST_LOG_BUFFER     65536
+
+/** Default for HostLog_t.fFlushSize. */
+#define HOST_LOG_FLUSH_SIZE 32768
+
+/** Default for HostLog_t.fFlushDelay, milliseconds. */
+#define HOST_LOG_FLUSH_DELAY 1000
+
+/** An output file written in batches.
+  *
+  * The data is collected in fBuffer and written with one system call when
+  * fFlushSize bytes are pending or the oldest of them waited fFlushDelay ms,
+  * whatever comes first. A program waiting in poll()/epoll_wait() uses
+  * HostLogTimeout() as (part of) its timeout and calls HostLogTick().
+  */
+typedef struct {
+
+  int            fFd;                  // the file, -1 if not open
+  size_t         fFlushSize;           // write when this many bytes pending
+  long           fFlushDelay;          // ... or the oldest waited this long
+  size_t         fUsed;                // bytes pending in fBuffer
+  long long      fOldest;              // time (ms) of the oldest of them
+  unsigned long  fWrites;              // number of write system calls
+  unsigned long  fErrors;              // number of failed writes
+  char           fBuffer[HOST_LOG_BUFFER];
+
+} HostLog_t;
+
+/** Open (create or truncate) 'path', or append to it if 'append' is set.
+  *
+  * Returns 0 on success, -1 with errno set on error.
+  */
+extern int HostLogOpen(HostLog_t *log, const char *path, int append);
+
+/** Add 'len' bytes, may write the batch (see HostLog_t). */
+extern void HostLogWrite(HostLog_t *log, const void *data, size_t len);
+
+/** Write everything pending now. */
+extern void HostLogFlush(HostLog_t *log);
+
+/** Milliseconds until pending data is due, -1 if there is none. */
+extern int HostLogTimeout(const HostLog_t *log);
+
+/** Write the pending data if it is due. */
+extern void HostLogTick(HostLog_t *log);
+
+/** Flush and close the file. */
+extern void HostLogClose(HostLog_t *log);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _HostLog_h_ */
@@ -0,0 +1,207 @@
+/*
+ * File   : HostQueue.h
+ *
+ * Purpose: Bounded single producer / single consumer queue between threads
+ *          of the host programs.
+ *
+ * $Id$
+ */
+
+#ifndef _HostQueue_h_
+#define _HostQueue_h_
+
+/** @file HostQueue.h
+  * Lock-free queue of fixed size records between two threads.
+  *
+  * Like SerialRing.h: the number of slots is a power of two, head and tail
+  * are free running counters, the producer only writes fHead, the consumer
+  * only writes fTail. The records are written and read in place: the
+  * producer fills HostQueueSlot() and publishes it with HostQueuePush(), the
+  * consumer reads HostQueueFront() and frees it with HostQueuePop().
+  *
+  * A side which finds the queue empty (full) may sleep in HostQueueWait*(),
+  * a futex on the other side's counter. The other side only makes the wake
+  * up system call if somebody sleeps.
+  * @author
+  */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct {
+
+  uint32_t        fHead __attribute__((aligned(64)));  // records pushed
+  uint32_t        fConsumerSleeps;     // consumer waits on fHead
+  unsigned long   fFull;               // producer found the queue full
+
+  uint32_t        fTail __attribute__((aligned(64)));  // records popped
+  uint32_t        fProducerSleeps;     // producer waits on fTail
+  uint32_t        fMaxUsed;            // most records ever pending
+
+  uint32_t        fMask __attribute__((aligned(64)));  // slots - 1
+  size_t          fSize;               // size of a record
+  unsigned char  *fSlots;
+
+} HostQueue_t;
+
+/* ------------------------------------------------------------------------- */
+
+static inline int HostQueueInit(HostQueue_t *queue, uint32_t slots,
+                                size_t size)
+/*
+ * ABSTRACT:	Allocate 'slots' (a power of two) records of 'size' bytes.
+ *		Returns 0 or -1 with errno set.
+ */
+ {
+  if ( !slots || ( slots & ( slots - 1 ) ) ) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  queue->fHead = queue->fTail = 0;
+  queue->fConsumerSleeps = queue->fProducerSleeps = 0;
+  queue->fFull = 0;
+  queue->fMaxUsed = 0;
+  queue->fMask = slots - 1;
+  queue->fSize = ( size + 63 ) & ~(size_t)63;	// no false sharing
+  queue->fSlots = (unsigned char *)aligned_alloc( 64, slots * queue->fSize );
+
+  return queue->fSlots ? 0 : -1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void HostQueueFree(HostQueue_t *queue)
+ {
+  free( queue->fSlots );
+  queue->fSlots = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void HostQueueFutex(uint32_t *word, int op, uint32_t value,
+                                  long timeout_ms)
+ {
+  struct timespec ts;
+
+  ts.tv_sec = timeout_ms / 1000;
+  ts.tv_nsec = timeout_ms % 1000 * 1000000;
+
+  syscall( SYS_futex, word, op | FUTEX_PRIVATE_FLAG, value,
+           op == FUTEX_WAIT && timeout_ms >= 0 ? &ts : NULL, NULL, 0 );
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void *HostQueueSlot(HostQueue_t *queue)
+/*
+ * ABSTRACT:	Producer: the next free record or NULL if the queue is full.
+ */
+ {
+  const uint32_t head = queue->fHead;
+  const uint32_t used = head - __atomic_load_n( &queue->fTail,
+                                                __ATOMIC_ACQUIRE );
+
+  if ( used > queue->fMask ) {
+    queue->fFull++;
+    return NULL;
+  }
+
+  if ( used >= queue->fMaxUsed ) queue->fMaxUsed = used + 1;
+
+  return queue->fSlots + ( head & queue->fMask ) * queue->fSize;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void HostQueuePush(HostQueue_t *queue)
+/*
+ * ABSTRACT:	Producer: publish the record of HostQueueSlot().
+ */
+ {
+  __atomic_store_n( &queue->fHead, queue->fHead + 1, __ATOMIC_SEQ_CST );
+
+  if ( __atomic_load_n( &queue->fConsumerSleeps, __ATOMIC_SEQ_CST ) )
+    HostQueueFutex( &queue->fHead, FUTEX_WAKE, 1, -1 );
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline const void *HostQueueFront(HostQueue_t *queue)
+/*
+ * ABSTRACT:	Consumer: the oldest record or NULL if the queue is empty.
+ */
+ {
+  const uint32_t tail = queue->fTail;
+
+  if ( __atomic_load_n( &queue->fHead, __ATOMIC_ACQUIRE ) == tail )
+    return NULL;
+
+  return queue->fSlots + ( tail & queue->fMask ) * queue->fSize;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void HostQueuePop(HostQueue_t *queue)
+/*
+ * ABSTRACT:	Consumer: free the record of HostQueueFront().
+ */
+ {
+  __atomic_store_n( &queue->fTail, queue->fTail + 1, __ATOMIC_SEQ_CST );
+
+  if ( __atomic_load_n( &queue->fProducerSleeps, __ATOMIC_SEQ_CST ) )
+    HostQueueFutex( &queue->fTail, FUTEX_WAKE, 1, -1 );
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void HostQueueWaitData(HostQueue_t *queue, long timeout_ms)
+/*
+ * ABSTRACT:	Consumer: sleep until a record is pushed or 'timeout_ms'
+ *		(-1: no timeout) passed.
+ */
+ {
+  __atomic_store_n( &queue->fConsumerSleeps, 1, __ATOMIC_SEQ_CST );
+
+  const uint32_t head = __atomic_load_n( &queue->fHead, __ATOMIC_SEQ_CST );
+
+  if ( head == queue->fTail )
+    HostQueueFutex( &queue->fHead, FUTEX_WAIT, head, timeout_ms );
+
+  __atomic_store_n( &queue->fConsumerSleeps, 0, __ATOMIC_SEQ_CST );
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void HostQueueWaitSpace(HostQueue_t *queue, long timeout_ms)
+/*
+ * ABSTRACT:	Producer: sleep until a record is popped or 'timeout_ms'
+ *		(-1: no timeout) passed.
+ */
+ {
+  __atomic_store_n( &queue->fProducerSleeps, 1, __ATOMIC_SEQ_CST );
+
+  const uint32_t tail = __atomic_load_n( &queue->fTail, __ATOMIC_SEQ_CST );
+
+  if ( queue->fHead - tail > queue->fMask )
+    HostQueueFutex( &queue->fTail, FUTEX_WAIT, tail, timeout_ms );
+
+  __atomic_store_n( &queue->fProducerSleeps, 0, __ATOMIC_SEQ_CST );
+}
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _HostQueue_h_ */
@@ -0,0 +1,211 @@
+/*
+ * File   : HostSerial.c
+ *
+ * Purpose: Non-blocking serial port access for the host programs.
+ *
+ * $Id$
+ *
+ */
+
+
+#define _DEFAULT_SOURCE				// cfmakeraw(), B921600 etc.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/** @file HostSerial.c
+  * Serial ports (and ptys) for the host programs, opened non-blocking so
+  * a program can wait for several of them (and the keyboard) with epoll
+  * and read whatever arrived with a single system call.
+  * @author
+  */
+
+#include "HostSerial.h"
+
+/* ------------------------------------------------------------------------- */
+
+static speed_t HostSerialSpeed(unsigned long baud)
+/*
+ * ABSTRACT:	Map a baud rate to its termios constant.
+ *
+ * INPUT:	baud		Baud rate
+ * OUTPUT:	None
+ * RETURN:	The constant, B0 if not supported
+ */
+ {
+  switch ( baud ) {
+    case 1200:   return B1200;
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B460800
+    case 460800: return B460800;
+#endif /* B460800 */
+#ifdef B921600
+    case 921600: return B921600;
+#endif /* B921600 */
+  }
+
+  return B0;
+
+} // End HostSerialSpeed(unsigned long baud)
+
+/* ------------------------------------------------------------------------- */
+
+int HostSerialOpen(const char *device, unsigned long baud, int mode)
+/*
+ * ABSTRACT:	Open the device non-blocking, set up a tty for raw 8N1 I/O.
+ *		A pipe opened for writing, too, never reports EOF to its
+ *		reader, so it is opened for reading only; unless 'mode' is
+ *		O_WRONLY, then the open waits for the reader (as a shell
+ *		redirection does) and the pipe is made non-blocking after.
+ *
+ * INPUT:	device		Path of the device, e.g. /dev/ttyUSB0
+ *		baud		Baud rate
+ *		mode		O_RDONLY, O_WRONLY or O_RDWR
+ * OUTPUT:	None
+ * RETURN:	File descriptor, -1 on error
+ */
+ {
+  const speed_t   speed = HostSerialSpeed( baud );
+  struct termios  tio;
+  struct stat     st;
+  int             fd;
+
+  if ( speed == B0 ) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if ( stat( device, &st ) == 0 && S_ISFIFO( st.st_mode ) ) {
+
+    if ( mode != O_WRONLY )
+      return open( device, O_RDONLY | O_NONBLOCK );
+
+    fd = open( device, O_WRONLY );
+
+    if ( fd >= 0 && fcntl( fd, F_SETFL, O_NONBLOCK ) < 0 ) {
+      close( fd );
+      return -1;
+    }
+
+    return fd;
+  }
+
+  fd = open( device, mode | O_NOCTTY | O_NONBLOCK );
+  if ( fd < 0 ) return -1;
+
+  if ( tcgetattr( fd, &tio ) < 0 ) {
+
+    if ( errno != ENOTTY && errno != EINVAL ) {
+      close( fd );
+      return -1;
+    }
+
+    return fd;					// a file
+  }
+
+  cfmakeraw( &tio );				// 8 bit, no echo, no CR/LF mapping
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+  tio.c_iflag &= ~(IXON | IXOFF);
+  tio.c_cc[VMIN]  = 1;				// with VMIN 0 an empty read()
+  tio.c_cc[VTIME] = 0;				// returns 0 (EOF), not EAGAIN
+
+  cfsetispeed( &tio, speed );
+  cfsetospeed( &tio, speed );
+
+  if ( tcsetattr( fd, TCSANOW, &tio ) < 0 ) {
+    close( fd );
+    return -1;
+  }
+
+  return fd;
+
+} // End HostSerialOpen(const char *device, unsigned long baud, int mode)
+
+/* ------------------------------------------------------------------------- */
+
+ssize_t HostSerialRead(int fd, char *buf, size_t size)
+/*
+ * ABSTRACT:	Read what is there. A pty whose other side was closed reports
+ *		EIO, this is end of file as well.
+ *
+ * INPUT:	fd		File descriptor of HostSerialOpen()
+ *		size		Size of 'buf'
+ * OUTPUT:	buf		Characters read
+ * RETURN:	Number of characters, 0 if none pending, -1 on EOF/error
+ */
+ {
+  for (;;) {
+
+    const ssize_t n = read( fd, buf, size );
+
+    if ( n > 0 ) return n;
+
+    if ( n == 0 || errno == EIO ) {		// end of file
+      errno = 0;
+      return -1;
+    }
+
+    if ( errno == EAGAIN || errno == EWOULDBLOCK ) return 0;
+
+    if ( errno != EINTR ) return -1;
+  }
+
+} // End HostSerialRead(int fd, char *buf, size_t size)
+
+/* ------------------------------------------------------------------------- */
+
+int HostSerialWrite(int fd, const void *buf, size_t len)
+/*
+ * ABSTRACT:	Write everything, poll() for the port while its output
+ *		buffer is full.
+ *
+ * INPUT:	fd		File descriptor of HostSerialOpen()
+ *		buf		Characters to write
+ *		len		Number of characters in 'buf'
+ * OUTPUT:	None
+ * RETURN:	0 on success, -1 on error
+ */
+ {
+  const char *ptr = (const char *)buf;
+
+  while ( len ) {
+
+    const ssize_t n = write( fd, ptr, len );
+
+    if ( n >= 0 ) {
+      ptr += n;
+      len -= n;
+      continue;
+    }
+
+    if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+
+      struct pollfd pfd;
+
+      pfd.fd = fd;
+      pfd.events = POLLOUT;
+
+      if ( poll( &pfd, 1, -1 ) < 0 && errno != EINTR ) return -1;
+    }
+    else if ( errno != EINTR )
+      return -1;
+  }
+
+  return 0;
+
+} // End HostSerialWrite(int fd, const void *buf, size_t len)
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,52 @@
+/*
+ * File   : HostSerial.h
+ *
+ * Purpose: Non-blocking serial port access for the host programs.
+ *
+ * $Id$
+ */
+
+#ifndef _HostSerial_h_
+#define _HostSerial_h_
+
+/** @file HostSerial.h
+  * Declarations for file HostSerial.c
+  * @author
+  */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Open 'device' (serial port or pty) for non-blocking raw I/O.
+  *
+  * 'mode' is O_RDONLY, O_WRONLY or O_RDWR. A tty is set to 8N1 without flow
+  * control at 'baud', other files (pipes, regular files) are opened as they
+  * are. A pipe is read only unless 'mode' is O_WRONLY; a writer waits for
+  * its reader. Returns the file descriptor or -1 with errno set, EINVAL for
+  * a baud rate termios doesn't know.
+  */
+extern int HostSerialOpen(const char *device, unsigned long baud, int mode);
+
+/** Read all characters pending on 'fd', but not more than 'size'.
+  *
+  * Returns the number of characters, 0 if none are pending and -1 on error
+  * or end of file (errno = 0).
+  */
+extern ssize_t HostSerialRead(int fd, char *buf, size_t size);
+
+/** Write all 'len' characters of 'buf', waiting while the port is busy.
+  *
+  * Returns 0 on success, -1 on error.
+  */
+extern int HostSerialWrite(int fd, const void *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _HostSerial_h_ */
@@ -22,31 +22,73 @@
   * @author H.-J.Mathes, DC2IP
   */
 
-#if (defined __AVR__)
+#if (defined __AVR__) || (defined HOST_HAL)
 # include <avr/pgmspace.h>
 # include "lcd.h"
 #else
 # define PROGMEM
 # define PGM_P      const char *
 # define memcpy_P(_dest,_src,_size)  memcpy(_dest,_src,_size)
-#endif /* __AVR__ */
+#endif /* __AVR__ || HOST_HAL */
 
 #include "GPS.h"
 #include "LCDDisplay.h"
 
+/* The firmware writes to the HD44780 through lcd.h - on the AVR as well as
+   on the host (HostHal.c) - the host tools print the two lines instead. */
+#if (defined __AVR__) || (defined HOST_HAL)
+# define LCD_HD44780
+#endif /* __AVR__ || HOST_HAL */
+
 static EDisplayMode gDisplayMode = kDateTime;
+static uint8_t      gDisplayStale = 1;  // mode changed, nothing shown yet
 
 static char gLCDLine_0[16];
 static char gLCDLine_1[16];
 
+/** The seconds of an angle, as shown, and the angles they are valid for. */
+typedef struct {
+  GpsCacheRange_t fRange;   // |angle| (1e-7 degrees)
+  char            fText[2]; // "SS"
+} LcdSeconds_t;
+
+static LcdSeconds_t gLatSeconds;
+static LcdSeconds_t gLonSeconds;
+
+GpsCacheStats_t gLcdSecondsCache;
+
 // --- local prototypes
 
-static void LcdDisplayUpdate(void);
+static const char *LcdArcSeconds(int32_t angle, LcdSeconds_t *cache);
+
+/* ------------------------------------------------------------------------- */
+
+/** The fields of gGpsData shown in each of the display modes. */
+static const uint16_t gDisplayFields[] PROGMEM = {
+  kFieldTime | kFieldLatitude | kFieldLongitude,       // kTimeLocator
+  kFieldDate | kFieldTime,                             // kDateTime
+  kFieldLatitude | kFieldLongitude,                    // kLatLon
+  kFieldLatitude | kFieldLongitude,                    // kLatLonGeo
+  kFieldLatitude | kFieldLongitude | kFieldAltitude,   // kLocatorAltitude
+  kFieldSpeed | kFieldCourse,                          // kSpeedRoute
+  kFieldHDOP | kFieldSatellites                        // kDOP
+};
 
 /* ------------------------------------------------------------------------- */
 
 void LcdDisplayShow(void)
  {
+  // nothing to do if none of the fields shown changed
+
+  uint16_t fields;
+
+  memcpy_P( &fields, &gDisplayFields[gDisplayMode], sizeof(fields) );
+
+  if ( !gDisplayStale && !(gGpsData.fChanged & fields) )
+    return;
+
+  gDisplayStale = 0;
+
   // update local memory
 
   LcdDisplayUpdate();
@@ -63,7 +105,7 @@ void LcdDisplayShow(void)
 
   // and output the data
 
-#if (defined __AVR__)
+#ifdef LCD_HD44780
   lcd_gotoxy( 0, 0 );
   for (unsigned int i=0; i<sizeof(gLCDLine_0); i++ )
     lcd_putc( gLCDLine_0[i] );
@@ -82,13 +124,52 @@ void LcdDisplayShow(void)
   for (unsigned int i=0; i<sizeof(gLCDLine_1); i++ )
     printf("%c", gLCDLine_1[i] );
   printf("'\n");
-#endif /* __AVR__ */
+#endif /* LCD_HD44780 */
+}
+
+/* ------------------------------------------------------------------------- */
+
+/** Seconds (00..59) part of an angle in 1e-7 degrees, as two characters.
+  *
+  * They are only calculated again when 'angle' left the second of the last
+  * call with the same 'cache'.
+  */
+static const char *LcdArcSeconds(int32_t angle, LcdSeconds_t *cache)
+ {
+  const int32_t magnitude = angle < 0 ? -angle : angle;
+
+  if ( GpsCacheHit( &cache->fRange, magnitude ) ) {
+    gLcdSecondsCache.fHits++;
+    return cache->fText;
+  }
+
+  gLcdSecondsCache.fMisses++;
+
+  uint32_t fraction = (uint32_t)magnitude % 10000000UL;
+  uint16_t second = fraction * 36 / 100000UL;  // 3600 seconds per degree
+  uint8_t  seconds = second % 60;
+
+  // this second of the degree starts at ceil(second / 0.00036), the next
+  // one at ceil((second + 1) / 0.00036)
+
+  cache->fRange.fFrom = magnitude - fraction
+                        + ( second * 100000UL + 35 ) / 36;
+  cache->fRange.fTo   = magnitude - fraction
+                        + ( ( second + 1 ) * 100000UL + 35 ) / 36;
+
+  cache->fText[0] = '0' + seconds / 10;
+  cache->fText[1] = '0' + seconds % 10;
+
+  return cache->fText;
 }
 
 /* ------------------------------------------------------------------------- */
 
 void LcdDisplaySetMode(EDisplayMode mode)
  {
+  if ( mode != gDisplayMode )
+    gDisplayStale = 1;
+
   gDisplayMode = mode;
 }
 
@@ -109,34 +190,34 @@ static const char gLCDText_0_1[] PROGMEM = "     JN49FD     ";
 static const char gLCDText_1_0[] PROGMEM = "DATE:   .  .    "; // kDateTime
 static const char gLCDText_1_1[] PROGMEM = "TIME:   :  :  UT";
 
-#if (defined __AVR__)
+#ifdef LCD_HD44780
 static const char gLCDText_2_0[] PROGMEM = "LAT:    \337  '    "; // kLatLon
 static const char gLCDText_2_1[] PROGMEM = "LON:    \337  '    ";
 #else
 static const char gLCDText_2_0[] PROGMEM = "LAT:      '    "; // kLatLon
 static const char gLCDText_2_1[] PROGMEM = "LON:      '    ";
-#endif /* __AVR__ */
+#endif /* LCD_HD44780 */
 
 static const char gLCDText_3_0[] PROGMEM = "LOCATOR:        "; // kLocatorAltitude
 static const char gLCDText_3_1[] PROGMEM = "HEIGHT:        m";
 
 static const char gLCDText_4_0[] PROGMEM = "SPEED:    0 km/h"; // kSpeedRoute
-#if (defined __AVR__)
+#ifdef LCD_HD44780
 static const char gLCDText_4_1[] PROGMEM = "ROUTE:       0 \337";
 #else
 static const char gLCDText_4_1[] PROGMEM = "ROUTE:       0 ";
-#endif /* __AVR__ */
+#endif /* LCD_HD44780 */
 
 static const char gLCDText_5_0[] PROGMEM = "HDOP:           "; // kDOP
 static const char gLCDText_5_1[] PROGMEM = "SATS:           ";
 
-#if (defined __AVR__)
+#ifdef LCD_HD44780
 static const char gLCDText_6_0[] PROGMEM = "LAT:   \337  .     "; // kLatLonGeo
 static const char gLCDText_6_1[] PROGMEM = "LON:   \337  .     ";
 #else
 static const char gLCDText_6_0[] PROGMEM = "LAT:     .      "; // kLatLonGeo
 static const char gLCDText_6_1[] PROGMEM = "LON:     .      ";
-#endif /* __AVR__ */
+#endif /* LCD_HD44780 */
 
 
 static const PGM_P const gLCDText_0[] PROGMEM = {
@@ -159,9 +240,8 @@ static const PGM_P const gLCDText_1[] PROGMEM = {
   gLCDText_6_1,
 };
 
-static void LcdDisplayUpdate(void)
+void LcdDisplayUpdate(void)
  {
-  char temp[10];
   char *src;
   const PGM_P pLCD_0;
   const PGM_P pLCD_1;
@@ -217,8 +297,6 @@ static void LcdDisplayUpdate(void)
 
   // fill display strings with data
 
-  uint16_t seconds;
-
   switch ( gDisplayMode ) {
 
     case kTimeLocator:
@@ -243,20 +321,8 @@ static void LcdDisplayUpdate(void)
       gLCDLine_0[9] = *src++;
       gLCDLine_0[10] = *src++;
 
-      strncpy( temp, &gGpsData.fLatitude[5], 4 ); temp[4] = 0;
-      seconds = atoi( temp ) * 6;
-      seconds /= 1000;
-#if (defined __AVR__)
-      if ( seconds < 10 ) {
-        temp[0] = '0';
-        itoa( seconds, &temp[1], 10 );
-      }
-      else
-        itoa( seconds, temp, 10 );
-#else
-      sprintf(temp,"%02d",seconds);
-#endif // __AVR__
-      strncpy( &gLCDLine_0[12], temp, 2);
+      memcpy( &gLCDLine_0[12],
+              LcdArcSeconds( gGpsData.fFix.fLatitude, &gLatSeconds ), 2 );
 
       gLCDLine_0[14] = '"';
       gLCDLine_0[15] = gGpsData.fNorthSouth[0];
@@ -268,20 +334,8 @@ static void LcdDisplayUpdate(void)
       gLCDLine_1[9] = *src++;
       gLCDLine_1[10] = *src++;
 
-      strncpy( temp, &gGpsData.fLongitude[6], 4 ); temp[4] = 0;
-      seconds = atoi( temp ) * 6;
-      seconds /= 1000;
-#if (defined __AVR__)
-      if ( seconds < 10 ) {
-        temp[0] = '0';
-        itoa( seconds, &temp[1], 10 );
-      }
-      else
-        itoa( seconds, temp, 10 );
-#else
-      sprintf(temp,"%02d",seconds);
-#endif // __AVR__
-      strncpy( &gLCDLine_1[12], temp, 2);
+      memcpy( &gLCDLine_1[12],
+              LcdArcSeconds( gGpsData.fFix.fLongitude, &gLonSeconds ), 2 );
 
       gLCDLine_1[14] = '"';
       gLCDLine_1[15] = gGpsData.fEastWest[0];
@@ -14,6 +14,8 @@
   * @author H.-J.Mathes, DC2IP
   */
 
+#include "GPS.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -34,8 +36,18 @@ typedef enum {
 } EDisplayMode;
 
 extern void LcdDisplaySetMode(EDisplayMode);
+
+/** Show gGpsData, unless none of the fields of the current display mode
+  * changed (see GpsData_t::fChanged) and the mode is still the same.
+  */
 extern void LcdDisplayShow(void);
 
+/** Fill the display lines from gGpsData, without output (see LcdDisplayShow()). */
+extern void LcdDisplayUpdate(void);
+
+/** Counters of the seconds of latitude and longitude shown by kLatLon. */
+extern GpsCacheStats_t gLcdSecondsCache;
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -7,7 +7,11 @@ Functions:	extern void	SerialInit(void)
 		extern void	SerialPutByte(unsigned char chr)
 		extern void 	SerialPutString(const char *address)
 		extern void 	SerialPutString_p(const char *progmem_address)
+		extern unsigned char SerialPutBuffer(const void *data,
+					unsigned int len, unsigned char flags)
+		extern unsigned char SerialTxPending(void)
 		extern void 	SerialProcesses(void)
+		extern unsigned int SerialRxOverruns(void)
 		ISR(USART_RXC_vect)
 		ISR(USART_TXC_vect)
 
@@ -15,6 +19,10 @@ Revisions:	1.00	04/14/03	GND	Original - Gary N. Dion
 		1.01	11/01/04	GND	Modified for ISR based transmit
 		1.02	11/02/04	GND	Optimized the ASCII routine (later removed)
 		1.03	05/26/05	GND	Converted to C++ comment style
+		1.04	10/17/26		Power-of-two RX ring with overrun counter,
+					drain all pending bytes per call
+		1.05	10/17/26		TX queue of (pointer, length) descriptors
+					sent in place instead of a byte buffer
 
 Copyright:	(c)2005, Gary N. Dion (me@garydion.com). All rights reserved.
 		This software is available only for non-commercial amateur radio
@@ -30,6 +38,7 @@ $Id: Serial.c,v 1.1 2009/08/11 10:14:20 avr Exp $
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <string.h>
 
 #include "global.h"
 
@@ -38,20 +47,27 @@ extern void MsgHandler(unsigned char);
 
 // App required include files
 #include "Serial.h"
+#include "SerialRing.h"
 
-// Educated guess for good buffer sizes
-#define UART_RX_BUFFER_SIZE	(96)
-#define UART_TX_BUFFER_SIZE	(96)
+// Number of TX descriptors, a power of two
+#define UART_TX_QUEUE_SIZE	(8)
+#define UART_TX_QUEUE_MASK	(UART_TX_QUEUE_SIZE - 1)
 
-// variables for USART RX part
-static unsigned char inbuf[UART_RX_BUFFER_SIZE];	// USART input buffer array
-static unsigned char inhead;				// USART input buffer head pointer
-static unsigned char intail;				// USART input buffer tail pointer
+// variables for USART RX part (see SerialRing.h, size SERIAL_RING_SIZE)
+static SerialRing_t inring;				// USART input ring buffer
 
 // variables for USART TX part
-static unsigned char outbuf[UART_TX_BUFFER_SIZE];	// USART output buffer array
-static unsigned char outhead;				// USART output buffer head pointer
-static unsigned char outtail;				// USART output buffer tail pointer
+typedef struct {
+  const char	*data;					// Next byte to send (RAM or flash)
+  unsigned int	len;					// Bytes left
+  unsigned char	flags;					// SERIAL_TX_PROGMEM
+  unsigned char	byte;					// Storage for SerialPutByte()
+} SerialTxDesc_t;
+
+static volatile SerialTxDesc_t outqueue[UART_TX_QUEUE_SIZE];	// USART output descriptors
+static volatile unsigned char outhead;			// Descriptors ever queued
+static volatile unsigned char outtail;			// Descriptors ever finished
+static volatile unsigned char outbusy;			// Transmitter running
 
 // Baud rate calculations (see http://www.mikrocontroller.net/articles/AVR-GCC-Tutorial#UART_initialisieren)
 #define BAUD 4800L          					// Baud rate, the L is important, DON'T use UL !
@@ -95,25 +111,139 @@ void		SerialInit(void)
 } // End SerialInit(void)
 
 
+/******************************************************************************/
+static unsigned char	SerialTxNext(void)
+/*******************************************************************************
+* ABSTRACT:	Places the next byte of the oldest descriptor in the transmit
+*		register. A descriptor is finished (and its slot free) as soon
+*		as its last byte was read, so its buffer may be reused then.
+*
+*		Must be called with interrupts disabled (or from the ISR)
+*		and only when the transmit register is empty.
+*
+* INPUT:	None
+* OUTPUT:	None
+* RETURN:	1 if a byte was sent, 0 if the queue is empty
+*/
+{
+  while (outtail != outhead)				  // While descriptors are pending
+  {
+    volatile SerialTxDesc_t *desc = &outqueue[outtail & UART_TX_QUEUE_MASK];
+
+    if (desc->len)
+    {
+      if (desc->flags & SERIAL_TX_PROGMEM)
+        UDR = pgm_read_byte(desc->data);		    // Send the byte from flash ...
+      else
+        UDR = *desc->data;				    // ... or from RAM
+      desc->data++;
+
+      if (--desc->len == 0) outtail++;			    // Last byte read, release slot
+      return 1;
+    }
+
+    outtail++;						    // Empty, skip it
+  }
+
+  return 0;
+
+} // End SerialTxNext(void)
+
+
+/******************************************************************************/
+static volatile SerialTxDesc_t *SerialTxSlot(unsigned char flags)
+/*******************************************************************************
+* ABSTRACT:	Returns the next free descriptor. If the queue is full, waits
+*		with SERIAL_TX_WAIT (unless interrupts are disabled, nothing
+*		would free a slot then) and fails otherwise.
+*
+* INPUT:	flags		SERIAL_TX_WAIT
+* OUTPUT:	None
+* RETURN:	The descriptor, 0 if the queue is full
+*/
+{
+  while ((unsigned char)(outhead - outtail) == UART_TX_QUEUE_SIZE)
+  {
+    if (!(flags & SERIAL_TX_WAIT) || !(SREG & (1<<SREG_I)))
+      return 0;						    // Caller handles backpressure
+  }
+
+  return &outqueue[outhead & UART_TX_QUEUE_MASK];
+
+} // End SerialTxSlot(unsigned char flags)
+
+
+/******************************************************************************/
+static void	SerialTxCommit(void)
+/*******************************************************************************
+* ABSTRACT:	Hands the descriptor filled in after SerialTxSlot() to the ISR
+*		and starts the transmitter if it is idle.
+*
+* INPUT:	None
+* OUTPUT:	None
+* RETURN:	None
+*/
+{
+  unsigned char	sreg = SREG;
+
+  cli();
+  outhead++;
+  if (!outbusy) outbusy = SerialTxNext();
+  SREG = sreg;
+
+} // End SerialTxCommit(void)
+
+
+/******************************************************************************/
+unsigned char	SerialPutBuffer(const void *data, unsigned int len, unsigned char flags)
+/*******************************************************************************
+* ABSTRACT:	This function queues a buffer for sending without copying it.
+*		The buffer must not change until it was sent, i.e. until
+*		SerialTxPending() no longer counts it.
+*
+* INPUT:	*data		Bytes to send, in RAM or (SERIAL_TX_PROGMEM) flash
+*		len		Number of bytes
+*		flags		SERIAL_TX_PROGMEM, SERIAL_TX_WAIT
+* OUTPUT:	None
+* RETURN:	1 if queued, 0 if the queue was full
+*/
+{
+  volatile SerialTxDesc_t *desc;
+
+  if (len == 0) return 1;				  // Nothing to do
+
+  if (!(desc = SerialTxSlot(flags))) return 0;		  // Queue full
+
+  desc->data = (const char *)data;
+  desc->len = len;
+  desc->flags = flags & SERIAL_TX_PROGMEM;
+  SerialTxCommit();
+
+  return 1;
+
+} // End SerialPutBuffer(const void *data, unsigned int len, unsigned char flags)
+
+
 /******************************************************************************/
 void		SerialPutByte(unsigned char chr)
 /*******************************************************************************
-* ABSTRACT:	This function pushes a new character into the output buffer
-*		then pre-advances the pointer to the next empty location.
+* ABSTRACT:	This function queues a single character. The character is
+*		kept in the descriptor itself, so it costs a whole slot.
 *
 * INPUT:	chr			byte to send
 * OUTPUT:	None
 * RETURN:	None
 */
 {
-  if (++outhead == UART_TX_BUFFER_SIZE) outhead = 0;	  // Advance and wrap pointer
-  outbuf[outhead] = chr;				  // Transfer the byte to output buffer
+  volatile SerialTxDesc_t *desc;
 
-  if (UCSRA & (1<<UDRE))				  // If the transmit buffer is empty
-  {
-    if (++outtail == UART_TX_BUFFER_SIZE) outtail = 0;// Advance and wrap pointer
-    UDR = outbuf[outtail];			    // Place the byte in the output buffer
-  }
+  if (!(desc = SerialTxSlot(SERIAL_TX_WAIT))) return;	  // Interrupts off and full
+
+  desc->byte = chr;					  // Transfer the byte to the descriptor
+  desc->data = (const char *)&desc->byte;
+  desc->len = 1;
+  desc->flags = 0;
+  SerialTxCommit();
 
 } // End SerialPutByte(unsigned char chr)
 
@@ -122,16 +252,14 @@ void		SerialPutByte(unsigned char chr)
 void SerialPutString(const char *address)
 /*******************************************************************************
 * ABSTRACT:	This function sends a null-terminated string to the serial port.
+*		The string is sent in place and must stay unchanged until then.
 *
 * INPUT:	*address	Pointer to string to send (ASCIIZ)
 * OUTPUT:	None
 * RETURN:	None
 */
 {
-  while (*address != 0) 				  // While not to the string end yet
-  {
-    SerialPutByte(*(address++));			    // Send the byte and increment index
-  }
+  SerialPutBuffer(address, strlen(address), SERIAL_TX_WAIT);
 
 } // End SerialPutString(char *address)
 
@@ -147,50 +275,90 @@ void SerialPutString_p(const char *progmem_address)
 * RETURN:	None
 */
 {
-  register char c;
-
-  while ( (c = pgm_read_byte(progmem_address++)) )   // While not to the string end yet
-    SerialPutByte(c);
+  SerialPutBuffer(progmem_address, strlen_P(progmem_address),
+                  SERIAL_TX_PROGMEM | SERIAL_TX_WAIT);
 
 } // End SerialPutString(char *address)
 
 
+/******************************************************************************/
+unsigned char	SerialTxPending(void)
+/*******************************************************************************
+* ABSTRACT:	Number of queued descriptors whose data was not read yet.
+*
+* INPUT:	None
+* OUTPUT:	None
+* RETURN:	Number of descriptors, 0 when all buffers may be reused
+*/
+{
+  return (unsigned char)(outhead - outtail);
+
+} // End SerialTxPending(void)
+
+
 /******************************************************************************/
 void 	SerialProcesses(void)
 /*******************************************************************************
 * ABSTRACT:	Called by main.c during idle time.
 *
-*		Processes any waiting serial characters coming in or going
-*		out both serial ports.
+*		Processes all serial characters waiting when called, so a
+*		slow pass of the main loop (LCD update) is caught up at once.
+*		Bytes arriving meanwhile are left for the next call.
 *
 * INPUT:	None
 * OUTPUT:	None
 * RETURN:	None
 */
 {
-  if (intail != inhead) 			  // If there are incoming bytes pending
+  unsigned char pending = SerialRingCount(&inring);	  // Bytes pending right now
+
+  while (pending--)
   {
-    if (++intail == UART_RX_BUFFER_SIZE) intail = 0;	    // Advance and wrap pointer
-    MsgHandler(inbuf[intail]);  	    // And pass it to a handler
+    MsgHandler(SerialRingGet(&inring));		    // Pass each to the handler
   }
 
 } // End SerialProcesses(void)
 
 
+/******************************************************************************/
+unsigned int	SerialRxOverruns(void)
+/*******************************************************************************
+* ABSTRACT:	Number of received bytes lost so far, because the input ring
+*		was full or the USART itself overran (data overrun flag).
+*
+* INPUT:	None
+* OUTPUT:	None
+* RETURN:	Number of bytes lost (wraps around)
+*/
+{
+  unsigned char	sreg = SREG;				  // 16 bit read, keep the ISR out
+  unsigned int	count;
+
+  cli();
+  count = inring.fOverruns;
+  SREG = sreg;
+
+  return count;
+
+} // End SerialRxOverruns(void)
+
+
 /******************************************************************************/
 ISR(USART_RXC_vect)
 /*******************************************************************************
 * ABSTRACT:	Called by the receive ISR (interrupt).
 *
-*		Saves the next serial byte to the head of the RX buffer.
+*		Saves the next serial byte to the head of the RX buffer, or
+*		counts it as lost if the buffer is full.
 *
 * INPUT:	None
 * OUTPUT:	None
 * RETURN:	None
 */
 {
-  if (++inhead == UART_RX_BUFFER_SIZE) inhead = 0;	  // Advance and wrap buffer pointer
-  inbuf[inhead] = UDR;  				  // Transfer the byte to the input buffer
+  if (UCSRA & (1<<DOR)) inring.fOverruns++;		  // USART lost a byte before this one
+
+  SerialRingPut(&inring, UDR);				  // Transfer the byte to the input buffer
 
 } // End ISR(USART_RXC_vect)
 
@@ -200,17 +368,14 @@ ISR(USART_TXC_vect)
 /*******************************************************************************
 * ABSTRACT:	Called by the transmit ISR (interrupt).
 *
-*		Puts the next serial byte into the TX register.
+*		Puts the next serial byte of the queued descriptors into the
+*		TX register, or marks the transmitter idle.
 *
 * INPUT:	None
 * OUTPUT:	None
 * RETURN:	None
 */
 {
-  if (outtail != outhead)				// If there are outgoing bytes pending
-  {
-    if (++outtail == UART_TX_BUFFER_SIZE) outtail = 0;	// Advance and wrap pointer
-    UDR = outbuf[outtail];			    	// Place the byte in the output buffer
-  }
+  outbusy = SerialTxNext();				// Send the next byte, if any
 
 } // End ISR(USART_TXC_vect)
@@ -3,7 +3,7 @@ File:		Serial.h
 
  		Serial functions module definitions/declarations.
 
-Version:	1.03
+Version:	1.05
 
 $Id: Serial.h,v 1.1 2009/08/11 10:14:20 avr Exp $
 
@@ -12,11 +12,19 @@ $Id: Serial.h,v 1.1 2009/08/11 10:14:20 avr Exp $
 #ifndef _Serial_h_
 #define _Serial_h_
 
+// flags of SerialPutBuffer()
+#define SERIAL_TX_PROGMEM	0x01		// data is in flash (PROGMEM)
+#define SERIAL_TX_WAIT		0x02		// wait while the TX queue is full
+
 // external function prototypes
 extern void	SerialInit(void);
 extern void	SerialPutByte(unsigned char chr);
 extern void 	SerialPutString(const char *address);
 extern void 	SerialPutString_p(const char *address);
+extern unsigned char SerialPutBuffer(const void *data, unsigned int len,
+				     unsigned char flags);
+extern unsigned char SerialTxPending(void);
 extern void 	SerialProcesses(void);
+extern unsigned int SerialRxOverruns(void);
 
 #endif // _Serial_h_
@@ -0,0 +1,105 @@
+/*
+ * File   : SerialRing.h
+ *
+ * Purpose: Single producer / single consumer byte ring for the USART.
+ *
+ * $Id$
+ */
+
+#ifndef _SerialRing_h_
+#define _SerialRing_h_
+
+/** @file SerialRing.h
+  * Byte ring shared by an interrupt routine and the main loop.
+  *
+  * The size is a power of two, head and tail are free running 8 bit counters
+  * and only masked when the buffer is indexed, so the number of pending bytes
+  * is simply head - tail and a full ring is told apart from an empty one
+  * without wasting an element. The producer only writes fHead (and
+  * fOverruns), the consumer only writes fTail, so neither side needs to
+  * disable interrupts. A full ring drops the new byte and counts it instead
+  * of overwriting data not read yet.
+  *
+  * Nothing in here depends on the AVR, the ring compiles on the host as well.
+  * @author
+  */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Number of bytes in a ring, a power of two, at most 128 (8 bit counters). */
+#ifndef SERIAL_RING_SIZE
+# define SERIAL_RING_SIZE    128
+#endif /* SERIAL_RING_SIZE */
+
+#if (SERIAL_RING_SIZE & (SERIAL_RING_SIZE - 1)) || (SERIAL_RING_SIZE > 128)
+# error SERIAL_RING_SIZE must be a power of two not larger than 128
+#endif
+
+#define SERIAL_RING_MASK    (SERIAL_RING_SIZE - 1)
+
+typedef struct {
+
+  volatile unsigned char  fHead;       // bytes ever put (producer)
+  volatile unsigned char  fTail;       // bytes ever taken (consumer)
+  volatile unsigned int   fOverruns;   // bytes dropped (producer)
+  volatile unsigned char  fBuffer[SERIAL_RING_SIZE];
+
+} SerialRing_t;
+
+/* ------------------------------------------------------------------------- */
+
+static inline void SerialRingInit(SerialRing_t *ring)
+ {
+  ring->fHead = 0;
+  ring->fTail = 0;
+  ring->fOverruns = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/** Number of bytes pending. */
+static inline unsigned char SerialRingCount(const SerialRing_t *ring)
+ {
+  return (unsigned char)(ring->fHead - ring->fTail);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/** Add a byte (producer side). Returns 0 and counts an overrun if full. */
+static inline unsigned char SerialRingPut(SerialRing_t *ring, unsigned char chr)
+ {
+  const unsigned char head = ring->fHead;
+
+  if ( (unsigned char)(head - ring->fTail) == SERIAL_RING_SIZE ) {
+    ring->fOverruns++;
+    return 0;
+  }
+
+  ring->fBuffer[head & SERIAL_RING_MASK] = chr;
+  ring->fHead = head + 1;                      // publish after the store
+
+  return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/** Remove the oldest byte (consumer side), the ring must not be empty. */
+static inline unsigned char SerialRingGet(SerialRing_t *ring)
+ {
+  const unsigned char tail = ring->fTail;
+  const unsigned char chr = ring->fBuffer[tail & SERIAL_RING_MASK];
+
+  ring->fTail = tail + 1;                      // release after the load
+
+  return chr;
+}
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _SerialRing_h_ */
@@ -0,0 +1,406 @@
+
+//
+// File   : gpsbench.cc
+//
+// Purpose: Micro benchmarks of the GPS decoding and LCD display routines
+//
+// $Id$
+//
+
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>   // getopt() stuff
+
+#include "GPS.h"
+#ifndef APRS
+# include "LCDDisplay.h"
+#endif /* APRS */
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
+
+// --- allocation counters
+//
+// The program is linked with '-Wl,--wrap=malloc,...' (see SConscript), so
+// all heap allocations of the C modules under test end up here. The C++
+// runtime itself is not affected.
+
+static unsigned long gAllocations = 0;
+
+extern "C" {
+
+  extern void *__real_malloc(size_t size);
+  extern void *__real_calloc(size_t nmemb, size_t size);
+  extern void *__real_realloc(void *ptr, size_t size);
+
+  void *__wrap_malloc(size_t size)
+   {
+    gAllocations++;
+    return __real_malloc( size );
+  }
+
+  void *__wrap_calloc(size_t nmemb, size_t size)
+   {
+    gAllocations++;
+    return __real_calloc( nmemb, size );
+  }
+
+  void *__wrap_realloc(void *ptr, size_t size)
+   {
+    gAllocations++;
+    return __real_realloc( ptr, size );
+  }
+
+} // extern "C"
+
+// --------------------------------------------------------------------------
+
+static void Usage(const char *pname)
+ {
+  cerr << "Usage: " << pname << " [-r <rounds>] [-t <msec>] <nmea-file> ..."
+       << endl << endl;
+  cerr << "Example: " << pname << " Data/*.dat" << endl;
+}
+
+// --------------------------------------------------------------------------
+
+static double Now(void)
+ {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// --------------------------------------------------------------------------
+
+/** Name of the configuration GPS.c was compiled for. */
+static const char *Config(void)
+ {
+#if (defined GPS_NAVILOCK)
+# ifdef APRS
+  return "navilock+aprs";
+# else
+  return "navilock";
+# endif /* APRS */
+#else
+# ifdef APRS
+  return "garmin+aprs";
+# else
+  return "garmin";
+# endif /* APRS */
+#endif /* GPS_NAVILOCK */
+}
+
+// --------------------------------------------------------------------------
+
+// --- the input data
+
+static string                gStream;   // all files, concatenated
+static unsigned long         gLines;    // sentences (lines) in gStream
+static vector<GpsParser_t>   gParsers;  // parser state at each kTRUE
+static vector<GpsData_t>     gFixes;    // gGpsData after each GpsMsgPrepare()
+
+static void CollectSentence(GpsParser_t *parser, size_t offset, void *arg)
+ {
+  GpsData_t data;
+
+  (void)offset;
+  (void)arg;
+
+  gParsers.push_back( *parser );
+
+  GpsParserPrepare( parser, &data );
+  gFixes.push_back( data );
+}
+
+// --------------------------------------------------------------------------
+
+// --- the benchmarks, each one runs a single pass and returns its ops
+
+static unsigned long gSink = 0;     // keeps the optimizer from dropping work
+
+static unsigned long BenchHandler(void)
+ {
+  const char *ptr = gStream.data();
+  const size_t len = gStream.size();
+
+  for ( size_t i = 0; i < len; i++ )
+    gSink += GpsMsgHandler( ptr[i] );
+
+  return len;
+}
+
+// the same per-char pass and GpsMsgParseBuffer(), counted in sentences: the
+// bulk parser should do at least 10x the sentences/sec of the per-char one
+static unsigned long BenchHandlerLines(void)
+ {
+  BenchHandler();
+
+  return gLines;
+}
+
+static unsigned long BenchParseBuffer(void)
+ {
+  gSink += GpsMsgParseBuffer( gStream.data(), gStream.size(), NULL, NULL );
+
+  return gLines;
+}
+
+static unsigned long BenchPrepare(void)
+ {
+  static GpsParser_t parser;
+
+  for ( size_t i = 0; i < gParsers.size(); i++ ) {
+    parser = gParsers[i];
+    GpsParserPrepare( &parser, &gGpsData );
+  }
+
+  return gParsers.size();
+}
+
+static unsigned long BenchUpdate(void)
+ {
+  static GpsParser_t parser;
+
+  // gGpsData holds the fix before, only the changed fields are copied
+  for ( size_t i = 0; i < gParsers.size(); i++ ) {
+    parser = gParsers[i];
+    GpsParserUpdate( &parser, &gGpsData, 0 );
+  }
+
+  return gParsers.size();
+}
+
+static unsigned long BenchParserCopy(void)
+ {
+  static GpsParser_t parser;
+
+  for ( size_t i = 0; i < gParsers.size(); i++ ) {
+    parser = gParsers[i];
+    gSink += parser.fCommas;
+  }
+
+  return gParsers.size();
+}
+
+static unsigned long BenchFixCopy(void)
+ {
+  for ( size_t i = 0; i < gFixes.size(); i++ ) {
+    gGpsData = gFixes[i];
+    gSink += gGpsData.fStatus;
+  }
+
+  return gFixes.size();
+}
+
+static unsigned long BenchFeet(void)
+ {
+  for ( size_t i = 0; i < gFixes.size(); i++ ) {
+    gGpsData = gFixes[i];
+    GpsCalculateFeet();
+    gSink += gAltitudeFeet[0];
+  }
+
+  return gFixes.size();
+}
+
+#ifndef APRS
+static unsigned long BenchLocator(void)
+ {
+  for ( size_t i = 0; i < gFixes.size(); i++ ) {
+    gGpsData = gFixes[i];
+    GpsCalculateLocator();
+    gSink += gLocator[0];
+  }
+
+  return gFixes.size();
+}
+
+static unsigned long BenchDisplay(void)
+ {
+  for ( size_t i = 0; i < gFixes.size(); i++ ) {
+    gGpsData = gFixes[i];
+    LcdDisplayUpdate();
+  }
+
+  return gFixes.size();
+}
+#endif /* APRS */
+
+// --------------------------------------------------------------------------
+
+static unsigned int  gRounds = 5;       // best of ...
+static double        gMinTime = 0.1;    // seconds per round at least
+
+static void Run(const char *name, const char *mode, const char *unit,
+                unsigned long (*bench)(void))
+/*
+ * ABSTRACT:	Repeat 'bench' until a round took gMinTime, print the fastest
+ *		of gRounds rounds as one line of the result table.
+ */
+ {
+  double        best = 1e30;
+  unsigned long ops = 0;
+  unsigned long allocs = 0;
+
+  for ( unsigned int r = 0; r < gRounds; r++ ) {
+
+    unsigned long round_ops = 0;
+    const unsigned long a0 = gAllocations;
+    const double t0 = Now();
+    double t;
+
+    do {
+      round_ops += bench();
+      t = Now() - t0;
+    } while ( t < gMinTime );
+
+    if ( t / round_ops < best ) best = t / round_ops;
+
+    ops += round_ops;
+    allocs += gAllocations - a0;
+  }
+
+  printf( "%-14s %-20s %-16s %-8s %12lu %10.1f %14.0f %10.4f\n",
+          Config(), name, mode, unit, ops, best * 1e9, 1 / best,
+          (double)allocs / ops );
+}
+
+// --------------------------------------------------------------------------
+
+//
+// run with:
+//  ./gpsbench Data/*.dat
+//
+
+int main(int argc,char** argv)
+ {
+  if ( argc < 2 ) {
+    Usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  // --- read application parameters from the cmd line
+
+  int getopt_status;
+
+  do {
+
+    getopt_status = getopt( argc, argv, "r:t:?" );
+
+    if ( getopt_status == EOF ) break;
+
+    switch ( getopt_status ) {
+
+      case 'r': gRounds = atoi( optarg );
+        	if ( !gRounds ) gRounds = 1;
+        	break;
+
+      case 't': gMinTime = atof( optarg ) / 1000;
+        	break;
+
+      case '?': Usage( argv[0] );
+        	exit( EXIT_FAILURE );
+        	break;
+
+      default: printf ( "Encountered unknown option: %d,%c\n",
+	       getopt_status, getopt_status );
+    }
+
+  } while ( getopt_status != EOF );
+
+  // read the data and collect the decoded fixes
+  //
+  for ( int arg = optind; arg < argc; arg++ ) {
+
+    ifstream infile( argv[arg], ios::binary );
+
+    if ( !infile ) {
+      cerr << argv[0] << ": could not open NMEA data file "
+           << argv[arg] << endl;
+      exit( EXIT_FAILURE );
+    }
+
+    gStream.append( istreambuf_iterator<char>( infile ),
+                    istreambuf_iterator<char>() );
+  }
+
+  for ( size_t i = 0; i < gStream.size(); i++ )
+    if ( gStream[i] == '\n' ) gLines++;
+
+  static GpsParser_t parser;
+
+  GpsParserInit( &parser );
+  GpsParserParse( &parser, gStream.data(), gStream.size(),
+                  CollectSentence, NULL );
+
+  if ( gFixes.empty() ) {
+    cerr << argv[0] << ": no GPRMC/GPGGA sentences found" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  GpsMsgInit();
+
+  // --- the benchmarks, 'ns/op' is the best round
+
+  printf( "# %-12s %-20s %-16s %-8s %12s %10s %14s %10s\n",
+          "config", "bench", "mode", "unit", "ops", "ns/op", "ops/sec",
+          "allocs/op" );
+
+  Run( "GpsMsgHandler", "-", "char", BenchHandler );
+  Run( "GpsMsgHandler", "-", "sentence", BenchHandlerLines );
+  Run( "GpsMsgParseBuffer", "-", "sentence", BenchParseBuffer );
+  // GpsMsgPrepare() is GpsParserPrepare() on the global context, here it
+  // is run on copies of the parser state recorded at each epoch; the
+  // cost of these copies (and of loading the fixes into gGpsData for the
+  // remaining benchmarks) is included, see 'parser-copy' and 'fix-copy'
+  Run( "parser-copy", "-", "epoch", BenchParserCopy );
+  Run( "GpsMsgPrepare", "-", "epoch", BenchPrepare );
+  Run( "GpsParserUpdate", "-", "epoch", BenchUpdate );
+  Run( "fix-copy", "-", "fix", BenchFixCopy );
+  Run( "GpsCalculateFeet", "-", "fix", BenchFeet );
+#ifndef APRS
+  Run( "GpsCalculateLocator", "-", "fix", BenchLocator );
+
+  static const char * const kModeName[] = {
+    "kTimeLocator", "kDateTime", "kLatLon", "kLatLonGeo",
+    "kLocatorAltitude", "kSpeedRoute", "kDOP"
+  };
+
+  for ( int mode = 0; mode <= kMaxDisplayMode; mode++ ) {
+    LcdDisplaySetMode( (EDisplayMode)mode );
+    Run( "LcdDisplayUpdate", kModeName[mode], "fix", BenchDisplay );
+  }
+#endif /* APRS */
+
+  // --- the derived-value caches, over all rounds of the benchmarks above
+
+  printf( "# %-20s %12s %12s\n", "cache", "hits", "misses" );
+  printf( "  %-20s %12u %12u\n", "gAltitudeFeet",
+          gAltitudeFeetCache.fHits, gAltitudeFeetCache.fMisses );
+#ifndef APRS
+  printf( "  %-20s %12u %12u\n", "gLocator",
+          gLocatorCache.fHits, gLocatorCache.fMisses );
+  printf( "  %-20s %12u %12u\n", "LcdArcSeconds",
+          gLcdSecondsCache.fHits, gLcdSecondsCache.fMisses );
+#endif /* APRS */
+
+  if ( gSink == 42 ) printf( "\n" );		// use it
+
+  exit(EXIT_SUCCESS);
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -0,0 +1,480 @@
+//
+// File   : gpslatency.cc
+//
+// Purpose: Program which measures the latency from an NMEA sentence being
+//          written to a serial line until its fix is on the display
+//
+// $Id$
+//
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>   // getopt() stuff
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "GPS.h"
+#include "HostSerial.h"
+#include "LCDDisplay.h"
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
+
+static void Usage(const char *pname)
+ {
+  cerr << "Usage: " << pname << " [-b <baud>] [-r <repeat>] [-o <csvfile>] "
+       << "[-v] <nmea-file>" << endl << endl;
+  cerr << "Example: " << pname << " -b 115200 -r 10 Data/navilock.dat" << endl;
+}
+
+// --------------------------------------------------------------------------
+
+/** The sentences sent through the pty and their timing. */
+struct LatencyRun {
+
+  string                      fStream;   // all sentences, '\r\n' terminated
+  vector<size_t>              fEnd;      // offset behind each sentence
+  vector<long long>           fWritten;  // time (ns) of each write
+  int                         fMaster;   // pty master, written to
+  unsigned long               fBaud;     // pace of the writer, 0: none
+  int                         fError;    // errno of a failed write
+
+  // reader side
+  size_t                      fPos;      // stream offset of the chunk parsed
+  size_t                      fNext;     // first sentence not yet shown
+  vector<long long>           fLatency;  // per fix, ns
+  FILE                       *fCsv;      // per fix output (-o)
+  long long                   fLastShow; // time of the last fix shown
+};
+
+// --------------------------------------------------------------------------
+
+static long long Now(void)
+ {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// --------------------------------------------------------------------------
+
+static void *Writer(void *arg)
+/*
+ * ABSTRACT:	The gpssim side: write the sentences to the pty master, one
+ *		write() each, paced to the baud rate (8N1) if it is set. The
+ *		time is taken just before the write.
+ */
+ {
+  LatencyRun *run = (LatencyRun *)arg;
+
+  const long long t0 = Now();
+  size_t start = 0;
+
+  for ( size_t i=0; i<run->fEnd.size(); i++ ) {
+
+    if ( run->fBaud ) {
+
+      const long long due = t0 + (long long)( start * 10 * 1e9 / run->fBaud );
+      struct timespec ts;
+
+      ts.tv_sec  = due / 1000000000LL;
+      ts.tv_nsec = due % 1000000000LL;
+
+      while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL )
+              == EINTR )
+        ;
+    }
+
+    __atomic_store_n( &run->fWritten[i], Now(), __ATOMIC_RELEASE );
+
+    if ( HostSerialWrite( run->fMaster, run->fStream.data() + start,
+                          run->fEnd[i] - start ) < 0 ) {
+      run->fError = errno;
+      break;
+    }
+
+    start = run->fEnd[i];
+  }
+
+  return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+static void ShowFix(LatencyRun *run, size_t end)
+/*
+ * ABSTRACT:	Publish and show the fix of an epoch just completed, the
+ *		decode path of gpstest. 'end' is the stream offset behind the
+ *		sentence which completed it: the time from its write to the
+ *		end of LcdDisplayShow() is taken.
+ */
+ {
+  GpsData_t data;
+
+  // which sentence ends here ?
+
+  while ( run->fNext < run->fEnd.size() && run->fEnd[run->fNext] < end )
+    run->fNext++;
+
+  GpsMsgPrepareData( &data );
+  GpsMsgPublish( &data );
+
+  if ( GpsDataIsComplete( &gGpsData ) ) {
+
+    GpsMsgShow();
+
+    LcdDisplayShow();
+
+    GpsDataClear( &gGpsData );
+
+    const long long shown = Now();
+
+    if ( run->fNext < run->fEnd.size() && run->fEnd[run->fNext] == end ) {
+
+      const long long written =
+        __atomic_load_n( &run->fWritten[run->fNext], __ATOMIC_ACQUIRE );
+
+      run->fLatency.push_back( shown - written );
+
+      if ( run->fCsv )
+        fprintf( run->fCsv, "%lu,%lld,%lld,%.3f\n",
+                 (unsigned long)run->fNext, written, shown,
+                 ( shown - written ) * 1e-3 );
+    }
+
+    run->fLastShow = shown;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+static void SentenceDone(GpsParser_t *parser, size_t offset, void *arg)
+/*
+ * ABSTRACT:	Called by GpsMsgParseBuffer() for each complete epoch,
+ *		'offset' is behind the '\n' of its last sentence in the chunk.
+ */
+ {
+  LatencyRun *run = (LatencyRun *)arg;
+
+  (void)parser;
+
+  ShowFix( run, run->fPos + offset );
+}
+
+// --------------------------------------------------------------------------
+
+static void EpochTimeout(LatencyRun *run)
+/*
+ * ABSTRACT:	The line is silent (or all was sent), show the fix of the
+ *		current epoch if it is still pending - as gpstest does. Its
+ *		latency includes the GPS_EPOCH_TIMEOUT waited for.
+ */
+ {
+  if ( GpsMsgTimeout() != kTRUE ) return;
+
+  ShowFix( run, run->fPos );
+}
+
+// --------------------------------------------------------------------------
+
+static bool LoadSentences(LatencyRun *run, const char *fname,
+                          unsigned long repeat)
+/*
+ * ABSTRACT:	Read the lines starting with '$' (as gpssim sends them) and
+ *		append them 'repeat' times, each terminated by '\r\n'.
+ */
+ {
+  FILE *file = fopen( fname, "r" );
+
+  if ( !file ) return false;
+
+  string sentences;
+  char   line[256];
+
+  while ( fgets( line, sizeof(line), file ) ) {
+
+    if ( line[0] != '$' ) continue;
+
+    line[strcspn( line, "\r\n" )] = 0;
+
+    sentences += line;
+    sentences += "\r\n";
+  }
+
+  fclose( file );
+
+  for ( unsigned long r = 0; r < repeat; r++ ) {
+
+    for ( size_t pos = 0; pos < sentences.size(); ) {
+
+      const size_t next = sentences.find( '\n', pos ) + 1;
+
+      run->fEnd.push_back( run->fStream.size() + next );
+      pos = next;
+    }
+
+    run->fStream += sentences;
+  }
+
+  run->fWritten.assign( run->fEnd.size(), 0 );
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+static long long Percentile(const vector<long long> &sorted, double p)
+ {
+  if ( sorted.empty() ) return 0;
+
+  size_t i = (size_t)( p * sorted.size() );
+
+  return sorted[i < sorted.size() ? i : sorted.size() - 1];
+}
+
+// --------------------------------------------------------------------------
+
+//
+// run with:
+//  ./gpslatency Data/navilock.dat
+//  ./gpslatency -b 0 -r 100 -o latency.csv Data/navilock.dat
+//
+
+int main(int argc,char** argv)
+ {
+  if ( argc < 2 ) {
+    Usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  // --- read application parameters from the cmd line
+
+  LatencyRun     run;
+  unsigned long  repeat = 1;
+  bool           verbose = false;
+  const char    *csv_name = NULL;
+
+  run.fBaud = 4800;
+  run.fError = 0;
+  run.fPos = 0;
+  run.fNext = 0;
+  run.fCsv = NULL;
+  run.fLastShow = 0;
+
+  int getopt_status;
+
+  do {
+
+    getopt_status = getopt( argc, argv, "b:r:o:v?" );
+
+    if ( getopt_status == EOF ) break;
+
+    switch ( getopt_status ) {
+
+      case 'b': run.fBaud = strtoul( optarg, NULL, 10 );
+        	break;
+
+      case 'r': repeat = strtoul( optarg, NULL, 10 );
+        	break;
+
+      case 'o': csv_name = optarg;
+        	break;
+
+      case 'v': verbose = true;
+        	break;
+
+      case '?': Usage( argv[0] );
+        	exit( EXIT_FAILURE );
+        	break;
+
+      default: printf ( "Encountered unknown option: %d,%c\n",
+	       getopt_status, getopt_status );
+    }
+
+  } while ( getopt_status != EOF );
+
+  if ( optind >= argc ) {
+    Usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  if ( !LoadSentences( &run, argv[optind], repeat ) ) {
+    cerr << argv[0] << ": could not open NMEA data file " << argv[optind]
+         << ": " << strerror( errno ) << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  if ( run.fEnd.empty() ) {
+    cerr << argv[0] << ": no sentences in " << argv[optind] << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  if ( csv_name ) {
+    run.fCsv = fopen( csv_name, "w" );
+    if ( !run.fCsv ) {
+      cerr << argv[0] << ": could not open " << csv_name << ": "
+           << strerror( errno ) << endl;
+      exit( EXIT_FAILURE );
+    }
+    fprintf( run.fCsv, "# sentence,written_ns,shown_ns,latency_us\n" );
+  }
+
+  // the report goes to stdout, the display output (-v) as well or nowhere
+
+  FILE *report = fdopen( dup( STDOUT_FILENO ), "w" );
+
+  if ( !verbose && !freopen( "/dev/null", "w", stdout ) ) {
+    cerr << argv[0] << ": could not open /dev/null" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  // --- the pseudo terminal pair: gpssim writes the master, gpstest reads
+  //     the slave (raw, like a serial port)
+
+  run.fMaster = posix_openpt( O_RDWR | O_NOCTTY );
+
+  if ( run.fMaster < 0 || grantpt( run.fMaster ) < 0 ||
+       unlockpt( run.fMaster ) < 0 ) {
+    cerr << argv[0] << ": could not create a pty: " << strerror( errno )
+         << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  const int slave = HostSerialOpen( ptsname( run.fMaster ),
+                                    run.fBaud ? run.fBaud : 115200,
+                                    O_RDONLY );
+
+  if ( slave < 0 ) {
+    cerr << argv[0] << ": could not open " << ptsname( run.fMaster ) << ": "
+         << strerror( errno ) << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  GpsMsgInit();
+
+  LcdDisplaySetMode( kDateTime );
+
+  pthread_t writer;
+
+  const long long t0 = Now();
+
+  if ( pthread_create( &writer, NULL, Writer, &run ) ) {
+    cerr << argv[0] << ": could not start thread" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  // --- the gpstest side: read what is there, decode and display it
+
+  const size_t total = run.fStream.size();
+  char         buf[4096];
+  long long    last_read = Now();
+
+  while ( run.fPos < total ) {
+
+    const ssize_t n = HostSerialRead( slave, buf, sizeof(buf) );
+
+    if ( n < 0 ) {
+      cerr << argv[0] << ": read error: "
+           << ( errno ? strerror( errno ) : "end of file" ) << endl;
+      exit( EXIT_FAILURE );
+    }
+
+    if ( n == 0 ) {
+
+      const long long silent = ( Now() - last_read ) / 1000000;
+      struct pollfd   pfd;
+
+      if ( silent >= GPS_EPOCH_TIMEOUT )
+        EpochTimeout( &run );
+
+      pfd.fd = slave;
+      pfd.events = POLLIN;
+
+      if ( poll( &pfd, 1, silent < GPS_EPOCH_TIMEOUT ?
+                          GPS_EPOCH_TIMEOUT - silent : 1000 ) == 0 &&
+           run.fError ) break;
+      continue;
+    }
+
+    last_read = Now();
+
+    GpsMsgParseBuffer( buf, n, SentenceDone, &run );
+    run.fPos += n;
+  }
+
+  // the line is silent from now on: gpstest shows a pending epoch after
+  // GPS_EPOCH_TIMEOUT
+
+  const long long due = last_read + GPS_EPOCH_TIMEOUT * 1000000LL;
+  struct timespec ts;
+
+  ts.tv_sec  = due / 1000000000LL;
+  ts.tv_nsec = due % 1000000000LL;
+
+  while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL )
+          == EINTR )
+    ;
+
+  EpochTimeout( &run );
+
+  pthread_join( writer, NULL );
+
+  if ( run.fError )
+    cerr << argv[0] << ": write error: " << strerror( run.fError ) << endl;
+
+  fflush( stdout );
+
+  if ( run.fCsv )
+    fclose( run.fCsv );
+
+  close( slave );
+  close( run.fMaster );
+
+  // --- the report, one 'key: value' pair per line
+
+  vector<long long> sorted( run.fLatency );
+
+  sort( sorted.begin(), sorted.end() );
+
+  double elapsed = ( run.fLastShow - t0 ) * 1e-9;
+  double mean = 0;
+
+  if ( elapsed <= 0 ) elapsed = 1e-9;
+
+  for ( size_t i=0; i<sorted.size(); i++ )
+    mean += sorted[i];
+  if ( !sorted.empty() ) mean /= sorted.size();
+
+  fprintf( report, "baud: %lu\n", run.fBaud );
+  fprintf( report, "bytes: %lu\n", (unsigned long)run.fPos );
+  fprintf( report, "sentences: %lu\n", (unsigned long)run.fEnd.size() );
+  fprintf( report, "fixes: %lu\n", (unsigned long)sorted.size() );
+  fprintf( report, "seconds: %.6f\n", elapsed );
+  fprintf( report, "fixes/sec: %.0f\n", sorted.size() / elapsed );
+  fprintf( report, "bytes/sec: %.0f\n", run.fPos / elapsed );
+  fprintf( report, "latency_mean_us: %.1f\n", mean * 1e-3 );
+  fprintf( report, "latency_p50_us: %.1f\n", Percentile( sorted, 0.50 ) * 1e-3 );
+  fprintf( report, "latency_p99_us: %.1f\n", Percentile( sorted, 0.99 ) * 1e-3 );
+  fprintf( report, "latency_max_us: %.1f\n",
+           sorted.empty() ? 0.0 : sorted.back() * 1e-3 );
+
+  fclose( report );
+
+  exit( run.fError ? EXIT_FAILURE : EXIT_SUCCESS );
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -0,0 +1,525 @@
+//
+// File   : gpsmux.cc
+//
+// Purpose: Daemon which reads many GPS receivers (serial ports, ptys) from
+//          one epoll loop and provides the latest fix of each
+//
+// $Id$
+//
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>   // getopt() stuff
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "GPS.h"
+#include "HostSerial.h"
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
+
+static void Usage(const char *pname)
+ {
+  cerr << "Usage: " << pname << " [-b <baud>] [-u <socket>] [-t <seconds>] "
+       << "<serial-port> ..." << endl << endl;
+  cerr << "Example: " << pname << " -b 4800 -u /tmp/gpsmux.sock "
+       << "/dev/ttyUSB0 /dev/ttyUSB1" << endl;
+  cerr << "         socat - UNIX-CONNECT:/tmp/gpsmux.sock" << endl;
+}
+
+// --------------------------------------------------------------------------
+
+/** Size of the read buffer, shared by all ports. */
+#define MUX_CHUNK       4096
+
+/** Number of events taken from epoll_wait() at once. */
+#define MUX_EVENTS      64
+
+/** Interval of the housekeeping (reopening ports), ms. */
+#define MUX_TICK        1000
+
+/** epoll tags of the descriptors which are no ports. */
+#define MUX_TAG_LISTEN  0xfffffffeU
+#define MUX_TAG_SIGNAL  0xffffffffU
+
+/** A receiver: its parser context, latest fix and health counters. The
+  * size is fixed, so the memory is bounded by the number of ports.
+  */
+struct MuxPort {
+
+  string              fName;           // device name
+  int                 fFd;             // -1 while closed
+  GpsParser_t         fParser;         // decoding state of this stream
+  GpsData_t           fFix;            // latest fix (GpsParserUpdate())
+  long long           fFixTime;        // its time (CLOCK_MONOTONIC, ns)
+  unsigned long long  fBytes;          // characters read
+  long long           fReadTime;       // time of the last read
+  bool                fPending;        // read since the last timeout check
+  unsigned long       fEpochs;         // completed epochs, ...
+  unsigned long       fFixes;          // ... of them with a valid fix
+  unsigned long       fOpens;          // successful (re)opens
+  int                 fError;          // errno of the last failure
+};
+
+// --------------------------------------------------------------------------
+
+static long long Now(void)
+ {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// --------------------------------------------------------------------------
+
+static void SentenceDone(GpsParser_t *parser, size_t offset, void *arg)
+/*
+ * ABSTRACT:	Called by GpsParserParse() for each complete epoch of a
+ *		port: publish its data as the port's latest fix.
+ */
+ {
+  MuxPort *port = (MuxPort *)arg;
+
+  (void)offset;
+
+  GpsParserUpdate( parser, &port->fFix, 0 );	// the previous fix
+
+  port->fFixTime = Now();
+
+  if ( GpsDataIsValid( &port->fFix ) )
+    port->fFixes++;
+}
+
+// --------------------------------------------------------------------------
+
+static bool PortOpen(MuxPort *port, unsigned int id, int epoll_fd,
+                     unsigned long baud)
+/*
+ * ABSTRACT:	(Re)open a port and add it to the epoll set. The parser is
+ *		reset, a sentence cut by a reopen is dropped.
+ */
+ {
+  port->fFd = HostSerialOpen( port->fName.c_str(), baud, O_RDONLY );
+
+  if ( port->fFd < 0 ) {
+    port->fError = errno;
+    return false;
+  }
+
+  struct epoll_event event;
+
+  event.events = EPOLLIN;
+  event.data.u32 = id;
+
+  if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, port->fFd, &event ) < 0 ) {
+    port->fError = errno;
+    close( port->fFd );
+    port->fFd = -1;
+    return false;
+  }
+
+  GpsParserReset( &port->fParser );
+
+  port->fOpens++;
+  port->fError = 0;
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+static void PortClose(MuxPort *port, int error)
+ {
+  close( port->fFd );			// also removes it from the epoll set
+
+  port->fFd = -1;
+  port->fError = error;
+}
+
+// --------------------------------------------------------------------------
+
+static string Status(const vector<MuxPort> &ports)
+/*
+ * ABSTRACT:	One line per port: its health counters and its latest fix
+ *		(UTC time, position in degrees, altitude in m, speed in
+ *		km/h, course in degrees, satellites, 'A' = valid).
+ *
+ *		Of the dropped sentences, the ones with a wrong checksum
+ *		are counted apart from the ones cut off (by the next '$',
+ *		a line error or a reopen).
+ */
+ {
+  const long long now = Now();
+  string          status;
+  char            line[320];
+
+  status.reserve( ports.size() * 160 + 128 );
+
+  status += "# id device state bytes sentences checksum cut epochs fixes "
+            "opens age_ms time lat lon alt speed course sats valid\n";
+
+  for ( size_t i=0; i<ports.size(); i++ ) {
+
+    const MuxPort   &port = ports[i];
+    const GpsFix_t  &fix = port.fFix.fFix;
+
+    snprintf( line, sizeof(line),
+              "%lu %s %s %llu %u %u %u %lu %lu %lu %lld "
+              "%02lu%02lu%02lu.%03lu %.7f %.7f %.2f %.1f %.2f %u %c\n",
+              (unsigned long)i, port.fName.c_str(),
+              port.fFd >= 0 ? "open" :
+                ( port.fError ? strerror( port.fError ) : "closed" ),
+              port.fBytes, port.fParser.fSentences,
+              port.fParser.fChecksumErrors,
+              port.fParser.fRejected - port.fParser.fChecksumErrors,
+              port.fEpochs, port.fFixes, port.fOpens,
+              port.fFixTime ? ( now - port.fFixTime ) / 1000000 : -1LL,
+              (unsigned long)fix.fTime / 3600000,
+              (unsigned long)fix.fTime / 60000 % 60,
+              (unsigned long)fix.fTime / 1000 % 60,
+              (unsigned long)fix.fTime % 1000,
+              fix.fLatitude * 1e-7, fix.fLongitude * 1e-7,
+              fix.fAltitude * 0.01, fix.fSpeed * 0.1, fix.fCourse * 0.01,
+              (unsigned int)fix.fSatellites,
+              GpsDataIsValid( &port.fFix ) ? 'A' : 'V' );
+
+    status += line;
+  }
+
+  return status;
+}
+
+// --------------------------------------------------------------------------
+
+static int ListenOn(const char *path)
+/*
+ * ABSTRACT:	Create the (non-blocking) status socket, each client gets
+ *		Status() and is disconnected.
+ */
+ {
+  struct sockaddr_un addr;
+
+  if ( strlen( path ) >= sizeof(addr.sun_path) ) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  const int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                         0 );
+
+  if ( fd < 0 ) return -1;
+
+  memset( &addr, 0, sizeof(addr) );
+  addr.sun_family = AF_UNIX;
+  strcpy( addr.sun_path, path );
+
+  unlink( path );
+
+  if ( bind( fd, (struct sockaddr *)&addr, sizeof(addr) ) < 0 ||
+       listen( fd, 16 ) < 0 ) {
+    close( fd );
+    return -1;
+  }
+
+  return fd;
+}
+
+// --------------------------------------------------------------------------
+
+//
+// run with:
+//  ./gpsmux /dev/ttyUSB0 /dev/ttyUSB1
+//  ./gpssim -f 200 -r 10 -d /tmp/fleet &
+//  ./gpsmux -b 115200 -u /tmp/gpsmux.sock -t 10 /tmp/fleet/gps*
+//
+
+int main(int argc,char** argv)
+ {
+  if ( argc < 2 ) {
+    Usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  // --- read application parameters from the cmd line
+
+  unsigned long baud = 4800;
+  const char *socket_path = NULL;
+  long status_interval = 0;
+
+  int getopt_status;
+
+  do {
+
+    getopt_status = getopt( argc, argv, "b:u:t:?" );
+
+    if ( getopt_status == EOF ) break;
+
+    switch ( getopt_status ) {
+
+      case 'b': baud = strtoul( optarg, NULL, 10 );
+        	break;
+
+      case 'u': socket_path = optarg;
+        	break;
+
+      case 't': status_interval = strtol( optarg, NULL, 10 );
+        	break;
+
+      case '?': Usage( argv[0] );
+        	exit( EXIT_FAILURE );
+        	break;
+
+      default: printf ( "Encountered unknown option: %d,%c\n",
+	       getopt_status, getopt_status );
+    }
+
+  } while ( getopt_status != EOF );
+
+  if ( optind >= argc ) {
+    Usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  const unsigned int count = argc - optind;
+
+  // one descriptor per port
+
+  struct rlimit limit;
+
+  if ( getrlimit( RLIMIT_NOFILE, &limit ) == 0 &&
+       limit.rlim_cur < count + 16 ) {
+    limit.rlim_cur = limit.rlim_max < count + 16 ? limit.rlim_max : count + 16;
+    setrlimit( RLIMIT_NOFILE, &limit );
+  }
+
+  const int epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+
+  if ( epoll_fd < 0 ) {
+    cerr << "Error: epoll_create1(): " << strerror( errno ) << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  // SIGINT and SIGTERM end the loop, via a signalfd in the epoll set
+
+  sigset_t signals;
+  struct epoll_event event;
+
+  sigemptyset( &signals );
+  sigaddset( &signals, SIGINT );
+  sigaddset( &signals, SIGTERM );
+  sigprocmask( SIG_BLOCK, &signals, NULL );
+
+  const int signal_fd = signalfd( -1, &signals, SFD_NONBLOCK | SFD_CLOEXEC );
+
+  event.events = EPOLLIN;
+  event.data.u32 = MUX_TAG_SIGNAL;
+  epoll_ctl( epoll_fd, EPOLL_CTL_ADD, signal_fd, &event );
+
+  // the status socket (-u)
+
+  int listen_fd = -1;
+
+  if ( socket_path ) {
+
+    listen_fd = ListenOn( socket_path );
+
+    if ( listen_fd < 0 ) {
+      cerr << "Error: Could not listen on " << socket_path << ": "
+           << strerror( errno ) << endl;
+      exit( EXIT_FAILURE );
+    }
+
+    event.events = EPOLLIN;
+    event.data.u32 = MUX_TAG_LISTEN;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, listen_fd, &event );
+  }
+
+  // the ports, those which can't be opened now are retried every tick
+
+  vector<MuxPort> ports( count );
+  unsigned int    open_ports = 0;
+
+  for ( unsigned int i=0; i<count; i++ ) {
+
+    MuxPort &port = ports[i];
+
+    port.fName = argv[optind + i];
+    port.fFixTime = 0;
+    port.fReadTime = 0;
+    port.fPending = false;
+    port.fBytes = 0;
+    port.fEpochs = 0;
+    port.fFixes = 0;
+    port.fOpens = 0;
+
+    GpsParserInit( &port.fParser );
+    memset( &port.fFix, 0, sizeof(port.fFix) );
+
+    if ( PortOpen( &port, i, epoll_fd, baud ) )
+      open_ports++;
+    else
+      cerr << argv[0] << ": could not open " << port.fName << ": "
+           << strerror( port.fError ) << " (retrying)" << endl;
+  }
+
+  cerr << argv[0] << ": " << open_ports << " of " << count
+       << " ports open" << endl;
+
+  // main loop ...
+  //
+
+  bool       leave = false;
+  char       chunk[MUX_CHUNK];
+  long long  next_tick = Now() + MUX_TICK * 1000000LL;
+  long long  next_wake = next_tick;
+  long long  next_status = status_interval > 0 ?
+                             Now() + status_interval * 1000000000LL : 0;
+
+  while ( !leave ) {
+
+    struct epoll_event events[MUX_EVENTS];
+
+    // up to the next tick or epoch timeout, rounded up: no busy loop in
+    // the last millisecond
+
+    const long long wait = ( next_wake - Now() + 999999 ) / 1000000;
+    const int nevents = epoll_wait( epoll_fd, events, MUX_EVENTS,
+                                    wait > 0 ? (int)wait : 0 );
+
+    if ( nevents < 0 && errno != EINTR ) {
+      cerr << "Error: epoll_wait(): " << strerror( errno ) << endl;
+      break;
+    }
+
+    for ( int e=0; e<nevents; e++ ) {
+
+      const uint32_t tag = events[e].data.u32;
+
+      if ( tag == MUX_TAG_SIGNAL ) {
+        leave = true;
+      }
+      else if ( tag == MUX_TAG_LISTEN ) {
+
+        // the status, as much as the socket takes at once
+
+        const int client = accept4( listen_fd, NULL, NULL, SOCK_CLOEXEC );
+
+        if ( client >= 0 ) {
+          const string status = Status( ports );
+
+          // a client which went away already just misses it
+          send( client, status.data(), status.size(),
+                MSG_DONTWAIT | MSG_NOSIGNAL );
+          close( client );
+        }
+      }
+      else if ( tag < count ) {
+
+        // one read per event: a busy port can't starve the others
+
+        MuxPort &port = ports[tag];
+
+        if ( port.fFd < 0 ) continue;		// closed by an earlier event
+
+        const ssize_t len = HostSerialRead( port.fFd, chunk, sizeof(chunk) );
+
+        if ( len < 0 ) {
+          PortClose( &port, errno ? errno : EPIPE );
+          continue;
+        }
+
+        port.fBytes += len;
+        port.fReadTime = Now();
+        port.fPending = true;
+        port.fEpochs += GpsParserParse( &port.fParser, chunk, len,
+                                        SentenceDone, &port );
+      }
+    }
+
+    const long long now = Now();
+
+    if ( now >= next_tick ) {
+
+      next_tick = now + MUX_TICK * 1000000LL;
+
+      for ( unsigned int i=0; i<count; i++ )
+        if ( ports[i].fFd < 0 )
+          PortOpen( &ports[i], i, epoll_fd, baud );
+    }
+
+    // a port silent for GPS_EPOCH_TIMEOUT: the last sentences of its epoch
+    // got lost. The loop wakes up at the first of these deadlines.
+
+    next_wake = next_tick;
+
+    for ( unsigned int i=0; i<count; i++ ) {
+
+      MuxPort &port = ports[i];
+
+      if ( !port.fPending ) continue;
+
+      const long long due = port.fReadTime + GPS_EPOCH_TIMEOUT * 1000000LL;
+
+      if ( now < due ) {
+        if ( due < next_wake ) next_wake = due;
+        continue;
+      }
+
+      port.fPending = false;
+
+      if ( GpsParserTimeout( &port.fParser ) == kTRUE ) {
+        SentenceDone( &port.fParser, 0, &port );
+        port.fEpochs++;
+      }
+    }
+
+    if ( next_status && now >= next_status ) {
+
+      next_status = now + status_interval * 1000000000LL;
+
+      const string status = Status( ports );
+
+      fwrite( status.data(), 1, status.size(), stdout );
+      fflush( stdout );
+    }
+
+  } // while (!leave) ...
+
+  const string status = Status( ports );
+
+  fwrite( status.data(), 1, status.size(), stdout );
+
+  for ( unsigned int i=0; i<count; i++ )
+    if ( ports[i].fFd >= 0 )
+      close( ports[i].fFd );
+
+  if ( listen_fd >= 0 ) {
+    close( listen_fd );
+    unlink( socket_path );
+  }
+
+  close( signal_fd );
+  close( epoll_fd );
+
+  exit( EXIT_SUCCESS );
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -1,4 +1,3 @@
-
 //
 // File   : gpssim.cc
 //
@@ -12,12 +11,24 @@
 #include <iostream>
 #include <list>
 #include <string>
+#include <vector>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <climits>
 #include <unistd.h>   // getopt() stuff
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 
-#include <SerialPort.h>
+#include "HostCapture.h"
+#include "HostSerial.h"
 
 // --- C prototypes for linked ui.c
 
@@ -35,13 +46,39 @@ using namespace std;
 
 static void Usage(const char *pname)
  {
-  cerr << "Usage: " << pname << " -p <serial-port> "
-       << "[-i <input_file>]" << endl << endl;
+  cerr << "Usage: " << pname << " -p <serial-port> [-b <baud>] "
+       << "[-i <input_file>] [-r <rate> | -s <speed> [-l] [-c <port-id>] "
+       << "[-t <start>]] [-n <epochs>] [-v]" << endl;
+  cerr << "   or: " << pname << " -f <receivers> [-r <rate>] [-n <epochs>] "
+       << "[-d <link-dir>]" << endl << endl;
   cerr << "Example: " << pname << " -p /dev/ttyS0 -i gpstrack.dat" << endl;
+  cerr << "         " << pname << " -p /dev/pts/3 -b 115200 -r 10" << endl;
+  cerr << "         " << pname << " -p /dev/pts/3 -i Data/navilock.dat -s 10 -l"
+       << endl;
+  cerr << "         " << pname << " -p /dev/pts/3 -i nmea.cap -s 1 "
+       << "-t '2011-02-28 12:00:00'" << endl;
+  cerr << "         " << pname << " -f 200 -r 10 -d /tmp/fleet" << endl;
 }
 
 // --------------------------------------------------------------------------
 
+/** Interval between two sentences without -r, ns. */
+#define SEND_INTERVAL   10000000000LL
+
+/** The keyboard is looked at that often, ns. */
+#define KEY_INTERVAL    100000000LL
+
+/** Highest epoch rate, Hz. */
+#define MAX_RATE        50
+
+/** Time to get from one track point to the next with -r, s. */
+#define TRACK_SEGMENT   10.0
+
+/** Size of the buffer holding the sentences of one epoch. */
+#define EPOCH_SIZE      512
+
+// --------------------------------------------------------------------------
+
 static unsigned char GetNMEAChecksum(const std::string data)
  {
   if ( !data.length() ) return 0;
@@ -49,7 +86,9 @@ static unsigned char GetNMEAChecksum(const std::string data)
   unsigned char checksum = 0x00;
   const char *ptr = data.c_str();
 
-  while ( *ptr != '*' ) {
+  if ( *ptr == '$' ) ptr++;			// not part of the checksum
+
+  while ( *ptr && *ptr != '*' ) {
     checksum ^= *ptr++;
   }
 
@@ -58,6 +97,1117 @@ static unsigned char GetNMEAChecksum(const std::string data)
 
 // --------------------------------------------------------------------------
 
+static long long Now(clockid_t clock = CLOCK_MONOTONIC)
+ {
+  struct timespec ts;
+
+  clock_gettime( clock, &ts );
+
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// --------------------------------------------------------------------------
+
+static void SleepUntil(long long t)
+ {
+  struct timespec ts;
+
+  ts.tv_sec  = t / 1000000000LL;
+  ts.tv_nsec = t % 1000000000LL;
+
+  while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL )
+          == EINTR )
+    ;
+}
+
+// --------------------------------------------------------------------------
+
+/** A point of the track, degrees. */
+struct TrackPoint {
+
+  double fLat;
+  double fLon;
+};
+
+// --------------------------------------------------------------------------
+
+static bool ParsePosition(const string &sentence, TrackPoint *point)
+/*
+ * ABSTRACT:	Get the position of a GPRMC sentence (fields 3 to 6).
+ */
+ {
+  double lat, lon;
+  char   ns, ew;
+
+  if ( sentence.compare( 3, 3, "RMC" ) != 0 ) return false;
+
+  const size_t pos = sentence.find( ',', sentence.find( ',', 7 ) + 1 );
+
+  if ( pos == string::npos ||
+       sscanf( sentence.c_str() + pos + 1, "%lf,%c,%lf,%c",
+               &lat, &ns, &lon, &ew ) != 4 )
+    return false;
+
+  point->fLat = floor( lat / 100 ) + fmod( lat, 100 ) / 60;
+  point->fLon = floor( lon / 100 ) + fmod( lon, 100 ) / 60;
+
+  if ( ns == 'S' ) point->fLat = -point->fLat;
+  if ( ew == 'W' ) point->fLon = -point->fLon;
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+static size_t AppendSentence(char *buf, size_t used, size_t size,
+                             const char *body)
+/*
+ * ABSTRACT:	Append '<body>*<checksum>\r\n' to 'buf'.
+ */
+ {
+  const int n = snprintf( buf + used, size - used, "%s*%02X\r\n",
+                          body, GetNMEAChecksum( body ) );
+
+  return n > 0 && used + n < size ? used + n : used;
+}
+
+// --------------------------------------------------------------------------
+
+static size_t FormatEpoch(char *buf, size_t size, long long utc,
+                          const vector<TrackPoint> &track, double t)
+/*
+ * ABSTRACT:	The sentences of one epoch in the order of the Navilock module:
+ *		GPGGA, GPGSA, GPRMC, GPVTG. The position moves along 'track',
+ *		from one point to the next in TRACK_SEGMENT seconds.
+ *
+ * INPUT:	utc		Time of the epoch (ns since 1970)
+ *		track		Track points
+ *		t		Seconds since the start (position on the track)
+ * OUTPUT:	buf		The sentences
+ * RETURN:	Number of characters in 'buf'
+ */
+ {
+  // position, speed and course on the current segment
+
+  const size_t  segment = (size_t)( t / TRACK_SEGMENT ) % track.size();
+  const TrackPoint &a = track[segment];
+  const TrackPoint &b = track[(segment + 1) % track.size()];
+  const double  frac = fmod( t, TRACK_SEGMENT ) / TRACK_SEGMENT;
+
+  const double  lat = a.fLat + ( b.fLat - a.fLat ) * frac;
+  const double  lon = a.fLon + ( b.fLon - a.fLon ) * frac;
+
+  const double  north = ( b.fLat - a.fLat ) * 60;			  // nm
+  const double  east = ( b.fLon - a.fLon ) * 60 * cos( lat * M_PI / 180 );
+  const double  knots = sqrt( north * north + east * east ) * 3600 /
+                        TRACK_SEGMENT;
+  double        course = atan2( east, north ) * 180 / M_PI;
+
+  if ( course < 0 ) course += 360;
+
+  // time and date
+
+  const time_t  secs = utc / 1000000000LL;
+  const int     millis = ( utc % 1000000000LL ) / 1000000;
+  struct tm     tm;
+
+  gmtime_r( &secs, &tm );
+
+  char time_str[32], date_str[32], lat_str[32], lon_str[32], body[160];
+
+  snprintf( time_str, sizeof(time_str), "%02d%02d%02d.%03d",
+            tm.tm_hour, tm.tm_min, tm.tm_sec, millis );
+  snprintf( date_str, sizeof(date_str), "%02d%02d%02d",
+            tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100 );
+
+  // ddmm.mmmm, rounded to 1/10000 minute
+
+  const long alat = lround( fabs( lat ) * 600000 );
+  const long alon = lround( fabs( lon ) * 600000 );
+
+  snprintf( lat_str, sizeof(lat_str), "%02ld%02ld.%04ld,%c",
+            alat / 600000, alat % 600000 / 10000, alat % 10000,
+            lat < 0 ? 'S' : 'N' );
+  snprintf( lon_str, sizeof(lon_str), "%03ld%02ld.%04ld,%c",
+            alon / 600000, alon % 600000 / 10000, alon % 10000,
+            lon < 0 ? 'W' : 'E' );
+
+  size_t used = 0;
+
+  snprintf( body, sizeof(body), "$GPGGA,%s,%s,%s,1,09,1.0,118.5,M,47.9,M,,0000",
+            time_str, lat_str, lon_str );
+  used = AppendSentence( buf, used, size, body );
+
+  used = AppendSentence( buf, used, size,
+                         "$GPGSA,A,3,15,22,04,09,02,17,26,12,27,,,,1.4,1.0,1.0" );
+
+  snprintf( body, sizeof(body), "$GPRMC,%s,A,%s,%s,%.2f,%.2f,%s,,",
+            time_str, lat_str, lon_str, knots, course, date_str );
+  used = AppendSentence( buf, used, size, body );
+
+  snprintf( body, sizeof(body), "$GPVTG,%.2f,T,,M,%.2f,N,%.1f,K",
+            course, knots, knots * 1.852 );
+  used = AppendSentence( buf, used, size, body );
+
+  return used;
+}
+
+// --------------------------------------------------------------------------
+
+/** Length of a day, ns. */
+#define DAY_NS          86400000000000LL
+
+/** Largest single write when replaying as fast as possible. */
+#define REPLAY_BURST    65536
+
+// --------------------------------------------------------------------------
+
+static bool SentenceTime(const char *line, const char *end, long long *ns)
+/*
+ * ABSTRACT:	Get the UTC time of day (hhmmss[.sss]) of a sentence: field 1
+ *		of xxGGA, xxRMC, xxZDA, xxGNS, xxGST, field 5 of xxGLL.
+ *
+ * INPUT:	line		Start of the line
+ *		end		Behind the line
+ * OUTPUT:	ns		Time of day, ns
+ * RETURN:	true if the sentence has a valid time
+ */
+ {
+  if ( end - line < 8 || line[0] != '$' ) return false;
+
+  int field;
+
+  if ( !memcmp( line + 3, "GGA,", 4 ) || !memcmp( line + 3, "RMC,", 4 ) ||
+       !memcmp( line + 3, "ZDA,", 4 ) || !memcmp( line + 3, "GNS,", 4 ) ||
+       !memcmp( line + 3, "GST,", 4 ) )
+    field = 1;
+  else if ( !memcmp( line + 3, "GLL,", 4 ) )
+    field = 5;
+  else
+    return false;
+
+  const char *p = line;
+
+  while ( field ) {
+    while ( p < end && *p != ',' ) p++;
+    if ( p++ == end ) return false;
+    field--;
+  }
+
+  // hhmmss
+
+  int digits[6];
+
+  for ( int i=0; i<6; i++, p++ ) {
+    if ( p >= end || *p < '0' || *p > '9' ) return false;
+    digits[i] = *p - '0';
+  }
+
+  const int hour = digits[0] * 10 + digits[1];
+  const int min  = digits[2] * 10 + digits[3];
+  const int sec  = digits[4] * 10 + digits[5];
+
+  if ( hour > 23 || min > 59 || sec > 60 ) return false;
+
+  *ns = ( ( hour * 60LL + min ) * 60 + sec ) * 1000000000LL;
+
+  // fraction
+
+  if ( p < end && *p == '.' ) {
+    long long scale = 100000000LL;
+
+    for ( p++; p < end && *p >= '0' && *p <= '9'; p++, scale /= 10 )
+      *ns += ( *p - '0' ) * scale;
+  }
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+static size_t NextEpoch(const char *data, size_t size, size_t pos,
+                        long long *t)
+/*
+ * ABSTRACT:	Find the end of the epoch starting at 'pos': the lines up to
+ *		the next one with another time. Lines without a time belong
+ *		to the epoch they follow, those at the start of the file to
+ *		the first epoch.
+ *
+ * INPUT:	data, size	The file
+ *		pos		Start of the epoch
+ * OUTPUT:	t		Time of day of the epoch (ns), -1 if none
+ * RETURN:	Offset behind the epoch
+ */
+ {
+  *t = -1;
+
+  while ( pos < size ) {
+
+    const char *line = data + pos;
+    const char *end = (const char *)memchr( line, '\n', size - pos );
+
+    end = end ? end + 1 : data + size;
+
+    long long lt;
+
+    if ( SentenceTime( line, end, &lt ) ) {
+      if ( *t < 0 )
+        *t = lt;
+      else if ( lt != *t )
+        break;
+    }
+
+    pos = end - data;
+  }
+
+  return pos;
+}
+
+// --------------------------------------------------------------------------
+
+/** Timing of a replay, see ReplayWait(). */
+struct ReplayPace {
+
+  long long  fBase;                    // monotonic time of file time 0, ns
+  long long  fNextKey;                 // next look at the keyboard
+  long long  fMaxLate;                 // largest delay of a send so far
+};
+
+// --------------------------------------------------------------------------
+
+static bool ReplayWait(ReplayPace *pace, long long file_time, double speed)
+/*
+ * ABSTRACT:	Wait for the time of the next send: 'file_time' scaled by
+ *		'speed' after the start. The keyboard is looked at meanwhile,
+ *		'n' skips the wait (the ones after it are shifted), 'q' ends
+ *		the replay. As fast as possible (speed 0) there is no wait,
+ *		only 'q' is looked for.
+ *
+ * INPUT:	pace		Timing of the replay
+ *		file_time	Time of the send in the file, ns
+ *		speed		Speed factor, 0: as fast as possible
+ * OUTPUT:	pace		Updated
+ * RETURN:	false if the replay is to be left
+ */
+ {
+  long long now = Now();
+
+  if ( speed > 0 ) {
+
+    const long long due = pace->fBase + (long long)( file_time / speed );
+
+    while ( now < due ) {
+
+      SleepUntil( due < pace->fNextKey ? due : pace->fNextKey );
+      now = Now();
+
+      if ( now >= pace->fNextKey ) {
+
+        pace->fNextKey = now + KEY_INTERVAL;
+
+        if ( kbhit() ) {
+
+          switch ( getch() ) {
+
+            case 'n':
+            case 'N': pace->fBase -= due - now;	// skip the wait
+                      now = due;
+                      break;
+
+            case 'q':
+            case 'Q': return false;
+          }
+        }
+      }
+    }
+
+    if ( now - due > pace->fMaxLate ) pace->fMaxLate = now - due;
+  }
+  else if ( now >= pace->fNextKey ) {
+
+    pace->fNextKey = now + KEY_INTERVAL;
+
+    if ( kbhit() && toupper( getch() ) == 'Q' ) return false;
+  }
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+static int Replay(int fd, const char *fname, double speed, bool loop,
+                  unsigned long max_epochs, bool verbose)
+/*
+ * ABSTRACT:	Send a recorded file as it is, each epoch (see NextEpoch())
+ *		with one write at the time its UTC time field gives, relative
+ *		to the first one. The file is mapped, not read.
+ *
+ * INPUT:	fd		Serial port
+ *		fname		Recorded NMEA file
+ *		speed		Speed factor, 0: as fast as possible
+ *		loop		Start again at the end of the file
+ *		max_epochs	Stop after so many epochs, 0: never
+ *		verbose		Echo the epochs
+ * OUTPUT:	None
+ * RETURN:	EXIT_SUCCESS or EXIT_FAILURE
+ */
+ {
+  const int file = open( fname, O_RDONLY );
+  struct stat st;
+
+  if ( file < 0 || fstat( file, &st ) < 0 ) {
+    cerr << "Error: Could not open " << fname << ": " << strerror( errno )
+         << endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( st.st_size == 0 ) {
+    cerr << "Error: " << fname << " is empty" << endl;
+    return EXIT_FAILURE;
+  }
+
+  const size_t size = st.st_size;
+  const char  *data = (const char *)mmap( NULL, size, PROT_READ, MAP_PRIVATE,
+                                          file, 0 );
+
+  close( file );
+
+  if ( data == MAP_FAILED ) {
+    cerr << "Error: Could not map " << fname << ": " << strerror( errno )
+         << endl;
+    return EXIT_FAILURE;
+  }
+
+  madvise( (void *)data, size, MADV_SEQUENTIAL );
+
+  // The file clock runs with the time fields: a step back by more than
+  // half a day is midnight, other steps back count as no time at all. At
+  // the end of a loop the last step is repeated.
+
+  size_t     pos = 0, burst = 0;
+  long long  file_time = 0;			// since the first epoch, ns
+  long long  last_t = -1, last_step = 1000000000LL;
+  bool       wrapped = false;
+
+  const long long start = Now();
+  ReplayPace pace = { start, 0, 0 };
+  unsigned long      sent = 0, loops = 0;
+  unsigned long long bytes = 0;
+
+  cout << "You might leave the main loop with 'q' or 'Q' ..." << endl;
+
+  while ( !( max_epochs && sent >= max_epochs ) ) {
+
+    if ( pos >= size ) {
+
+      if ( !loop ) break;
+
+      pos = burst = 0;
+      wrapped = true;
+      loops++;
+    }
+
+    long long t;
+    const size_t end = NextEpoch( data, size, pos, &t );
+
+    if ( t >= 0 ) {
+
+      if ( last_t >= 0 && !wrapped ) {
+        long long step = t - last_t;
+
+        if ( step < -DAY_NS / 2 ) step += DAY_NS;
+        if ( step > 0 ) {
+          last_step = step;
+          file_time += step;
+        }
+      }
+      else if ( wrapped )
+        file_time += last_step;
+
+      last_t = t;
+      wrapped = false;
+    }
+
+    if ( speed == 0 ) {
+
+      // as fast as possible: collect epochs into bursts
+
+      if ( end - burst < REPLAY_BURST && end < size &&
+           !( max_epochs && sent + 1 >= max_epochs ) ) {
+        pos = end;
+        sent++;
+        continue;
+      }
+
+      pos = burst;
+    }
+
+    // wait for the epoch, but look at the keyboard meanwhile
+
+    if ( !ReplayWait( &pace, file_time, speed ) ) break;
+
+    if ( verbose ) cout.write( data + pos, end - pos );
+
+    if ( HostSerialWrite( fd, data + pos, end - pos ) < 0 ) {
+      cerr << "Error: Could not write to port: " << strerror( errno ) << endl;
+      munmap( (void *)data, size );
+      return EXIT_FAILURE;
+    }
+
+    bytes += end - pos;
+    sent++;
+    pos = burst = end;
+  }
+
+  const double elapsed = ( Now() - start ) * 1e-9;
+
+  cout << endl << "sent: " << sent << " epochs, " << bytes << " bytes in "
+       << elapsed << " s (" << loops << " loops), "
+       << ( elapsed > 0 ? bytes / elapsed : 0 ) << " bytes/s, max. delay "
+       << pace.fMaxLate * 1e-6 << " ms" << endl;
+
+  munmap( (void *)data, size );
+
+  return EXIT_SUCCESS;
+}
+
+// --------------------------------------------------------------------------
+
+static long long ParseStartTime(const char *text)
+/*
+ * ABSTRACT:	Parse the start time of a capture replay (-t): UTC as
+ *		"YYYY-MM-DD HH:MM:SS" (or with a 'T' in between), or seconds
+ *		since 1970.
+ *
+ * INPUT:	text		The option's argument
+ * OUTPUT:	None
+ * RETURN:	CLOCK_REALTIME, ns; -1 if 'text' is no time
+ */
+ {
+  struct tm  tm;
+  char      *end;
+
+  memset( &tm, 0, sizeof(tm) );
+
+  end = strptime( text, "%Y-%m-%d", &tm );
+
+  if ( end && ( *end == ' ' || *end == 'T' ) )
+    end = strptime( end + 1, "%H:%M:%S", &tm );
+
+  if ( end && !*end )
+    return timegm( &tm ) * 1000000000LL;
+
+  const double seconds = strtod( text, &end );
+
+  if ( end == text || *end || seconds < 0 ) return -1;
+
+  return (long long)( seconds * 1e9 );
+}
+
+// --------------------------------------------------------------------------
+
+static int ReplayCapture(int fd, HostCaptureReader_t *reader, long port,
+                         long long start_time, double speed, bool loop,
+                         unsigned long max_epochs, bool verbose)
+/*
+ * ABSTRACT:	Send the characters of 'port' of a capture file (see gpstest
+ *		-c) in the chunks they were read and at their times, relative
+ *		to the first one and scaled by 'speed'. Gaps between sessions
+ *		are taken from their real time.
+ *
+ * INPUT:	fd		Serial port
+ *		reader		The capture file
+ *		port		Port id, -1: the first one with data
+ *		start_time	Start at the first record at or after this
+ *				real time (ns), also when looping; -1: at
+ *				the beginning
+ *		speed		Speed factor, 0: as fast as possible
+ *		loop		Start again at the end of the file
+ *		max_epochs	Stop after so many chunks, 0: never
+ *		verbose		Echo the chunks
+ * OUTPUT:	None
+ * RETURN:	EXIT_SUCCESS or EXIT_FAILURE
+ */
+ {
+  HostCaptureRecord_t record, session;
+
+  // capture time -> file clock: the monotonic time within a session, the
+  // real time between them (each boot restarts the monotonic clock)
+
+  long long  file_time = 0, last_time = -1;	// ns
+  long long  session_mono = -1, session_real = 0;
+  long long  last_step = 1000000000LL;
+  bool       first = true;
+
+  const long long start = Now();
+  ReplayPace pace = { start, 0, 0 };
+  unsigned long      sent = 0, loops = 0, lost = 0;
+  unsigned long long bytes = 0;
+
+  // the session the start is in counts as the first record read
+
+  session.fMeta = 0;
+
+  if ( start_time >= 0 )
+    HostCaptureSeek( reader, start_time, &session );
+
+  cout << "You might leave the main loop with 'q' or 'Q' ..." << endl;
+
+  while ( !( max_epochs && sent >= max_epochs ) ) {
+
+    if ( session.fMeta ) {
+      record = session;
+      session.fMeta = 0;
+    }
+    else if ( !HostCaptureNext( reader, &record ) ) {
+
+      if ( !loop || !sent ) break;
+
+      if ( start_time >= 0 )
+        HostCaptureSeek( reader, start_time, &session );
+      else
+        HostCaptureRewind( reader );
+
+      file_time += last_step;
+      last_time = -1;
+      session_mono = -1;
+      loops++;
+      continue;
+    }
+
+    if ( record.fMeta == HOST_CAPTURE_SESSION && record.fLen >= 8 ) {
+
+      long long real = 0;
+
+      for ( int i=7; i>=0; i-- ) real = real << 8 | record.fData[i];
+
+      if ( session_mono >= 0 && last_time >= 0 ) {
+        const long long gap = real - ( session_real + last_time - session_mono );
+
+        file_time += gap > 0 ? gap : 0;
+      }
+
+      session_mono = record.fTime;
+      session_real = real;
+      last_time = record.fTime;
+
+      if ( start_time > real )		// started within it: time from there
+        last_time += start_time - real;
+      continue;
+    }
+
+    if ( record.fMeta == HOST_CAPTURE_LOST && record.fPort == port )
+      lost++;
+
+    if ( record.fMeta || !record.fLen ) continue;
+
+    if ( port < 0 ) port = record.fPort;
+    if ( (long)record.fPort != port ) continue;
+
+    if ( last_time >= 0 && record.fTime > last_time ) {
+      last_step = record.fTime - last_time;
+      file_time += last_step;
+    }
+
+    last_time = record.fTime;
+
+    if ( first ) {			// the first chunk is sent at once
+      pace.fBase = Now() - (long long)( speed > 0 ? file_time / speed : 0 );
+      first = false;
+    }
+
+    if ( !ReplayWait( &pace, file_time, speed ) ) break;
+
+    if ( verbose ) cout.write( (const char *)record.fData, record.fLen );
+
+    if ( HostSerialWrite( fd, record.fData, record.fLen ) < 0 ) {
+      cerr << "Error: Could not write to port: " << strerror( errno ) << endl;
+      return EXIT_FAILURE;
+    }
+
+    bytes += record.fLen;
+    sent++;
+  }
+
+  const double elapsed = ( Now() - start ) * 1e-9;
+
+  cout << endl << "sent: " << sent << " chunks of port " << port << ", "
+       << bytes << " bytes in " << elapsed << " s (" << loops << " loops), "
+       << lost << " overruns recorded, max. delay " << pace.fMaxLate * 1e-6
+       << " ms" << endl;
+
+  return EXIT_SUCCESS;
+}
+
+// --------------------------------------------------------------------------
+
+/** Largest number of virtual receivers (-f). */
+#define MAX_FLEET       4096
+
+/** Each virtual receiver keeps its course and speed that long, s. */
+#define FLEET_LEG       60
+
+/** Positions are kept in 1/1024 of the NMEA resolution (0.0001'). */
+#define FLEET_SHIFT     10
+
+/** One degree in units of 0.0001'. */
+#define FLEET_DEGREE    600000LL
+
+/** A virtual receiver of the fleet (-f), sending on its own pty. */
+struct FleetReceiver {
+
+  int            fMaster;              // pty master, written to
+  int            fSlave;               // kept open: raw mode, no hangup
+  char           fName[32];            // the slave's device name
+  unsigned int   fSeed;                // for rand_r()
+  long long      fLat;                 // position, 0.0001' << FLEET_SHIFT
+  long long      fLon;
+  long           fDLat;                // movement per epoch, same units
+  long           fDLon;
+  unsigned int   fKnots;               // speed, 0.01 knots
+  unsigned int   fCourse;              // course, 0.1 degrees
+  unsigned int   fAlt;                 // altitude, 0.1 m
+  unsigned long  fDropped;             // epochs the pty had no room for
+  string         fTail;                // rest of an epoch it took in part
+};
+
+// --------------------------------------------------------------------------
+
+static char *PutDigits(char *ptr, unsigned long value, int width)
+/*
+ * ABSTRACT:	Write 'value' with 'width' digits (leading zeros).
+ */
+ {
+  for ( char *end = ptr + width; end > ptr; value /= 10 )
+    *--end = '0' + value % 10;
+
+  return ptr + width;
+}
+
+// --------------------------------------------------------------------------
+
+static char *PutNumber(char *ptr, unsigned long value, int decimals)
+/*
+ * ABSTRACT:	Write 'value' / 10^decimals with 'decimals' decimals.
+ */
+ {
+  char  digits[24];
+  int   n = 0;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while ( value || n <= decimals );
+
+  while ( n ) {
+    if ( n-- == decimals ) *ptr++ = '.';
+    *ptr++ = digits[n];
+  }
+
+  return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+static char *PutText(char *ptr, const char *text)
+ {
+  while ( *text ) *ptr++ = *text++;
+
+  return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+static char *PutPosition(char *ptr, long long pos, int width, char pos_hemi,
+                         char neg_hemi)
+/*
+ * ABSTRACT:	Write a latitude (width 2) or longitude (width 3) as
+ *		'dddmm.mmmm,H', 'pos' in 0.0001'.
+ */
+ {
+  const unsigned long long abs_pos = pos < 0 ? -pos : pos;
+
+  ptr = PutDigits( ptr, abs_pos / FLEET_DEGREE, width );
+  ptr = PutDigits( ptr, abs_pos % FLEET_DEGREE / 10000, 2 );
+  *ptr++ = '.';
+  ptr = PutDigits( ptr, abs_pos % 10000, 4 );
+  *ptr++ = ',';
+  *ptr++ = pos < 0 ? neg_hemi : pos_hemi;
+
+  return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+static char *EndSentence(char *start, char *ptr)
+/*
+ * ABSTRACT:	Append '*<checksum>\r\n' to the sentence at 'start'.
+ */
+ {
+  static const char hex[] = "0123456789ABCDEF";
+  unsigned char     checksum = 0;
+
+  for ( const char *p = start + 1; p < ptr; p++ )
+    checksum ^= *p;
+
+  *ptr++ = '*';
+  *ptr++ = hex[checksum >> 4];
+  *ptr++ = hex[checksum & 0x0f];
+  *ptr++ = '\r';
+  *ptr++ = '\n';
+
+  return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+static void FleetNewLeg(FleetReceiver *rcv, unsigned long rate)
+/*
+ * ABSTRACT:	Choose a new course and speed (up to 25 knots, steps over
+ *		50 km/h are rejected by GpsParserPrepare()), heading back
+ *		from the polar regions.
+ */
+ {
+  const long long lat = rcv->fLat >> FLEET_SHIFT;
+
+  rcv->fKnots = rand_r( &rcv->fSeed ) % 2501;
+  rcv->fCourse = rand_r( &rcv->fSeed ) % 3600;
+
+  if ( lat > 80 * FLEET_DEGREE ) rcv->fCourse = 1800;
+  if ( lat < -80 * FLEET_DEGREE ) rcv->fCourse = 0;
+
+  // 1 knot = 1' of latitude per hour
+
+  const double course = rcv->fCourse * M_PI / 1800;
+  const double step = rcv->fKnots / 100.0 * 10000 / 3600 / rate *
+                      ( 1 << FLEET_SHIFT );
+  const double lat_cos = cos( (double)lat / FLEET_DEGREE * M_PI / 180 );
+
+  rcv->fDLat = lround( step * cos( course ) );
+  rcv->fDLon = lround( step * sin( course ) / ( lat_cos > 0.1 ? lat_cos : 0.1 ) );
+}
+
+// --------------------------------------------------------------------------
+
+static size_t FleetEpoch(FleetReceiver *rcv, char *buf, const char *time_str,
+                         const char *date_str, const char *gsa, size_t gsa_len)
+/*
+ * ABSTRACT:	Move the receiver by one epoch and format its sentences
+ *		(GPGGA, GPGSA, GPRMC, GPVTG) into 'buf' (EPOCH_SIZE) with
+ *		integer arithmetic only.
+ *
+ * INPUT:	rcv		The receiver
+ *		time_str	hhmmss.sss of the epoch
+ *		date_str	ddmmyy of the epoch
+ *		gsa		The (constant) GPGSA sentence ...
+ *		gsa_len		... and its length
+ * OUTPUT:	buf		The sentences
+ * RETURN:	Number of characters in 'buf'
+ */
+ {
+  rcv->fLat += rcv->fDLat;
+  rcv->fLon += rcv->fDLon;
+
+  if ( rcv->fLon >= ( 180 * FLEET_DEGREE << FLEET_SHIFT ) )
+    rcv->fLon -= 360 * FLEET_DEGREE << FLEET_SHIFT;
+  if ( rcv->fLon < -( 180 * FLEET_DEGREE << FLEET_SHIFT ) )
+    rcv->fLon += 360 * FLEET_DEGREE << FLEET_SHIFT;
+
+  const long long lat = rcv->fLat >> FLEET_SHIFT;
+  const long long lon = rcv->fLon >> FLEET_SHIFT;
+
+  char *ptr = buf, *start;
+
+  start = ptr;
+  ptr = PutText( ptr, "$GPGGA," );
+  ptr = PutText( ptr, time_str );
+  *ptr++ = ',';
+  ptr = PutPosition( ptr, lat, 2, 'N', 'S' );
+  *ptr++ = ',';
+  ptr = PutPosition( ptr, lon, 3, 'E', 'W' );
+  ptr = PutText( ptr, ",1,09,1.0," );
+  ptr = PutNumber( ptr, rcv->fAlt, 1 );
+  ptr = PutText( ptr, ",M,47.9,M,,0000" );
+  ptr = EndSentence( start, ptr );
+
+  memcpy( ptr, gsa, gsa_len );
+  ptr += gsa_len;
+
+  start = ptr;
+  ptr = PutText( ptr, "$GPRMC," );
+  ptr = PutText( ptr, time_str );
+  ptr = PutText( ptr, ",A," );
+  ptr = PutPosition( ptr, lat, 2, 'N', 'S' );
+  *ptr++ = ',';
+  ptr = PutPosition( ptr, lon, 3, 'E', 'W' );
+  *ptr++ = ',';
+  ptr = PutNumber( ptr, rcv->fKnots, 2 );
+  *ptr++ = ',';
+  ptr = PutNumber( ptr, rcv->fCourse, 1 );
+  *ptr++ = ',';
+  ptr = PutText( ptr, date_str );
+  ptr = PutText( ptr, ",," );
+  ptr = EndSentence( start, ptr );
+
+  start = ptr;
+  ptr = PutText( ptr, "$GPVTG," );
+  ptr = PutNumber( ptr, rcv->fCourse, 1 );
+  ptr = PutText( ptr, ",T,,M," );
+  ptr = PutNumber( ptr, rcv->fKnots, 2 );
+  ptr = PutText( ptr, ",N," );
+  ptr = PutNumber( ptr, rcv->fKnots * 1852 / 10000, 1 );	// 0.1 km/h
+  ptr = PutText( ptr, ",K" );
+  ptr = EndSentence( start, ptr );
+
+  return ptr - buf;
+}
+
+// --------------------------------------------------------------------------
+
+static bool FleetOpen(FleetReceiver *rcv, const char *link_dir,
+                      unsigned int index)
+/*
+ * ABSTRACT:	Create the pty pair of a receiver: the master non-blocking,
+ *		the slave raw. If 'link_dir' is set, a symlink gpsNNN there
+ *		points to the slave.
+ */
+ {
+  rcv->fMaster = posix_openpt( O_RDWR | O_NOCTTY );
+  rcv->fSlave = -1;
+
+  if ( rcv->fMaster < 0 || grantpt( rcv->fMaster ) < 0 ||
+       unlockpt( rcv->fMaster ) < 0 ||
+       ptsname_r( rcv->fMaster, rcv->fName, sizeof(rcv->fName) ) != 0 ||
+       fcntl( rcv->fMaster, F_SETFL, O_NONBLOCK ) < 0 )
+    return false;
+
+  rcv->fSlave = open( rcv->fName, O_RDWR | O_NOCTTY );
+
+  struct termios mode;
+
+  if ( rcv->fSlave < 0 || tcgetattr( rcv->fSlave, &mode ) < 0 )
+    return false;
+
+  cfmakeraw( &mode );
+
+  if ( tcsetattr( rcv->fSlave, TCSANOW, &mode ) < 0 )
+    return false;
+
+  if ( link_dir ) {
+    char link_name[PATH_MAX];
+
+    snprintf( link_name, sizeof(link_name), "%s/gps%03u", link_dir, index );
+    unlink( link_name );
+
+    if ( symlink( rcv->fName, link_name ) < 0 )
+      return false;
+  }
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+static int Fleet(unsigned int count, unsigned long rate,
+                 unsigned long max_epochs, const char *link_dir)
+/*
+ * ABSTRACT:	Drive 'count' virtual receivers, each on its own pty with its
+ *		own trajectory: legs of FLEET_LEG seconds with random course
+ *		and speed, starting near the default track. Every epoch all
+ *		of them send at once; if a pty has no room (nobody reads),
+ *		the epoch is dropped for it. Epochs are sent whole: the rest
+ *		of one a pty took in part goes first, the next epoch is
+ *		dropped until it is out.
+ *
+ * INPUT:	count		Number of receivers
+ *		rate		Epochs per second
+ *		max_epochs	Stop after so many epochs, 0: never
+ *		link_dir	Directory for symlinks to the ptys, or NULL
+ * OUTPUT:	None
+ * RETURN:	EXIT_SUCCESS or EXIT_FAILURE
+ */
+ {
+  // two descriptors per receiver
+
+  struct rlimit limit;
+
+  if ( getrlimit( RLIMIT_NOFILE, &limit ) == 0 &&
+       limit.rlim_cur < 2 * count + 16 ) {
+    limit.rlim_cur = limit.rlim_max < 2 * count + 16 ? limit.rlim_max :
+                                                      2 * count + 16;
+    setrlimit( RLIMIT_NOFILE, &limit );
+  }
+
+  vector<FleetReceiver> fleet( count );
+
+  for ( unsigned int i=0; i<count; i++ ) {
+
+    FleetReceiver &rcv = fleet[i];
+
+    if ( !FleetOpen( &rcv, link_dir, i ) ) {
+      cerr << "Error: Could not create pty " << i << ": " << strerror( errno )
+           << endl;
+      return EXIT_FAILURE;
+    }
+
+    // somewhere within 0.5 degrees of 4905.7073N 00826.0084E
+
+    rcv.fSeed = i + 1;
+    rcv.fLat = ( 49 * FLEET_DEGREE + 57073 - FLEET_DEGREE / 2 +
+                 rand_r( &rcv.fSeed ) % FLEET_DEGREE ) << FLEET_SHIFT;
+    rcv.fLon = ( 8 * FLEET_DEGREE + 260084 - FLEET_DEGREE / 2 +
+                 rand_r( &rcv.fSeed ) % FLEET_DEGREE ) << FLEET_SHIFT;
+    rcv.fAlt = 1000 + rand_r( &rcv.fSeed ) % 5000;
+    rcv.fDropped = 0;
+
+    FleetNewLeg( &rcv, rate );
+
+    cout << rcv.fName << endl;
+  }
+
+  // the GPGSA sentence is the same for all of them
+
+  char  gsa[96];
+  char *gsa_end = PutText( gsa, "$GPGSA,A,3,15,22,04,09,02,17,26,12,27,,,,"
+                                "1.4,1.0,1.0" );
+  const size_t gsa_len = EndSentence( gsa, gsa_end ) - gsa;
+
+  // main loop: absolute deadlines on the UTC epoch grid as with -r
+
+  const long long period = 1000000000LL / rate;
+  long long       start = Now();
+  long long       start_utc = Now( CLOCK_REALTIME );
+  const long long wait = 1000000000LL - start_utc % 1000000000LL;
+
+  start += wait;
+  start_utc += wait;
+
+  long long      next = start;
+  long long      next_key = 0;
+  long long      max_late = 0;
+  unsigned long  epochs = 0, late = 0;
+  unsigned long long bytes = 0, dropped = 0;
+  bool           leave = false;
+  char           buf[EPOCH_SIZE];
+
+  cout << count << " receivers at " << rate << " Hz, "
+       << "you might leave the main loop with 'q' or 'Q' ..." << endl;
+
+  while ( !leave && !( max_epochs && epochs >= max_epochs ) ) {
+
+    long long now = Now();
+
+    if ( now >= next ) {
+
+      if ( now - next > max_late ) max_late = now - next;
+
+      // time and date of the epoch, once for all receivers
+
+      const long long utc = start_utc + ( next - start );
+      const time_t    secs = utc / 1000000000LL;
+      struct tm       tm;
+      char            time_str[16], date_str[8], *ptr;
+
+      gmtime_r( &secs, &tm );
+
+      ptr = PutDigits( time_str, tm.tm_hour, 2 );
+      ptr = PutDigits( ptr, tm.tm_min, 2 );
+      ptr = PutDigits( ptr, tm.tm_sec, 2 );
+      *ptr++ = '.';
+      ptr = PutDigits( ptr, utc % 1000000000LL / 1000000, 3 );
+      *ptr = 0;
+
+      ptr = PutDigits( date_str, tm.tm_mday, 2 );
+      ptr = PutDigits( ptr, tm.tm_mon + 1, 2 );
+      ptr = PutDigits( ptr, tm.tm_year % 100, 2 );
+      *ptr = 0;
+
+      const bool new_leg = epochs && epochs % ( FLEET_LEG * rate ) == 0;
+
+      for ( unsigned int i=0; i<count; i++ ) {
+
+        FleetReceiver &rcv = fleet[i];
+
+        if ( new_leg ) FleetNewLeg( &rcv, rate );
+
+        const size_t len = FleetEpoch( &rcv, buf, time_str, date_str,
+                                       gsa, gsa_len );
+        ssize_t      n;
+
+        if ( !rcv.fTail.empty() ) {
+
+          n = write( rcv.fMaster, rcv.fTail.data(), rcv.fTail.size() );
+
+          if ( n > 0 ) {
+            bytes += n;
+            rcv.fTail.erase( 0, n );
+          }
+
+          if ( !rcv.fTail.empty() ) {
+            rcv.fDropped++;
+            dropped++;
+            continue;
+          }
+        }
+
+        n = write( rcv.fMaster, buf, len );
+
+        if ( n > 0 ) {
+          bytes += n;
+
+          if ( n < (ssize_t)len ) rcv.fTail.assign( buf + n, len - n );
+        }
+        else {
+          rcv.fDropped++;
+          dropped++;
+        }
+      }
+
+      epochs++;
+      next += period;
+
+      now = Now();
+      if ( now - next > period ) {		// can't keep up
+        late++;
+        next = now;
+      }
+    }
+
+    if ( now >= next_key ) {
+
+      next_key = now + KEY_INTERVAL;
+
+      if ( kbhit() && toupper( getch() ) == 'Q' ) leave = true;
+    }
+
+    SleepUntil( next < next_key ? next : next_key );
+  }
+
+  const double elapsed = ( Now() - start ) * 1e-9;
+
+  cout << endl << "sent: " << epochs << " epochs to " << count
+       << " receivers, " << bytes << " bytes in " << elapsed << " s, "
+       << dropped << " dropped (pty full), " << late << " late, max. delay "
+       << max_late * 1e-6 << " ms" << endl;
+
+  for ( unsigned int i=0; i<count; i++ ) {
+
+    if ( link_dir ) {
+      char link_name[PATH_MAX];
+
+      snprintf( link_name, sizeof(link_name), "%s/gps%03u", link_dir, i );
+      unlink( link_name );
+    }
+
+    close( fleet[i].fSlave );
+    close( fleet[i].fMaster );
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// --------------------------------------------------------------------------
+
 //
 // GPS track in NMEA format:
 // - time (TTTTTT) and data (DDDDDD) will be replaced by software
@@ -88,6 +1238,11 @@ static const char * gDefaultTrack[] = {
 //
 // run with:
 //  ./gpssim -p /dev/ttyUSB0
+//  ./gpssim -p /dev/pts/3 -b 921600 -r 50 -n 3000
+//  ./gpssim -p /dev/pts/3 -b 115200 -i Data/navilock.dat -s 0 -l
+//  ./gpssim -p /dev/pts/3 -i nmea.cap -s 1       (capture of gpstest -c)
+//  ./gpssim -p /dev/pts/3 -i nmea.cap -s 1 -t '2011-02-28 12:00:00'
+//  ./gpssim -f 200 -r 10 -d /tmp/fleet
 //
 
 int main(int argc,char** argv)
@@ -101,12 +1256,22 @@ int main(int argc,char** argv)
 
   string infile_name;
   string ser_device;
+  unsigned long baud = 4800;
+  unsigned long rate = 0;
+  unsigned long max_epochs = 0;
+  bool verbose = false;
+  double speed = -1;
+  bool loop = false;
+  long capture_port = -1;
+  long long start_time = -1;
+  unsigned long fleet = 0;
+  const char *link_dir = NULL;
 
   int getopt_status;
 
   do {
 
-    getopt_status = getopt( argc, argv, "p:o:?" );
+    getopt_status = getopt( argc, argv, "b:c:d:f:i:ln:p:r:s:t:v?" );
 
     if ( getopt_status == EOF ) break;
 
@@ -116,12 +1281,47 @@ int main(int argc,char** argv)
 
     switch ( getopt_status ) {
 
+      case 'b': baud = strtoul( optarg, NULL, 10 );
+        	break;
+
+      case 'c': capture_port = strtol( optarg, NULL, 10 );
+        	break;
+
+      case 'd': link_dir = optarg;
+        	break;
+
+      case 'f': fleet = strtoul( optarg, NULL, 10 );
+        	break;
+
       case 'i': infile_name = optarg;
         	break;
 
+      case 'l': loop = true;
+        	break;
+
+      case 'n': max_epochs = strtoul( optarg, NULL, 10 );
+        	break;
+
       case 'p': ser_device = optarg;
         	break;
 
+      case 'r': rate = strtoul( optarg, NULL, 10 );
+        	break;
+
+      case 's': speed = strtod( optarg, NULL );
+        	break;
+
+      case 't': start_time = ParseStartTime( optarg );
+        	if ( start_time < 0 ) {
+        	  cerr << argv[0] << ": -t needs a UTC time as "
+        	       << "'YYYY-MM-DD HH:MM:SS' or seconds since 1970" << endl;
+        	  exit( EXIT_FAILURE );
+        	}
+        	break;
+
+      case 'v': verbose = true;
+        	break;
+
       case '?': Usage( argv[0] );
         	exit( EXIT_FAILURE );
         	break;
@@ -132,33 +1332,68 @@ int main(int argc,char** argv)
 
   } while ( getopt_status != EOF );
 
-  // Open the serial port.
-  //
-  SerialPort serial_port( ser_device );
+  if ( rate > MAX_RATE ) {
+    cerr << argv[0] << ": rate must be 1 ... " << MAX_RATE << " Hz" << endl;
+    exit( EXIT_FAILURE );
+  }
 
-  // Set communication parameters & open the port, catch exceptions
-  //
-  try {
-    serial_port.Open( SerialPort::BAUD_4800,
-		      SerialPort::CHAR_SIZE_8,
-		      SerialPort::PARITY_NONE,
-		      SerialPort::STOP_BITS_1,
-		      SerialPort::FLOW_CONTROL_NONE );
+  if ( speed >= 0 && ( infile_name.empty() || rate ||
+                       ( speed != 0 && ( speed < 0.1 || speed > 1000 ) ) ) ) {
+    cerr << argv[0] << ": -s needs -i and a speed of 0.1 ... 1000 "
+         << "(0: as fast as possible)" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  if ( start_time >= 0 && speed < 0 ) {
+    cerr << argv[0] << ": -t needs -s" << endl;
+    exit( EXIT_FAILURE );
   }
-  catch ( SerialPort::AlreadyOpen& ex ) {
-    cerr << "Error: Port is already open: " << ex.what() << endl;
-    exit(EXIT_FAILURE);
+
+  // a fleet of virtual receivers on ptys (-f) ...
+  //
+  if ( fleet ) {
+
+    if ( fleet > MAX_FLEET || speed >= 0 ) {
+      cerr << argv[0] << ": -f needs 1 ... " << MAX_FLEET << " receivers "
+           << "and no -s" << endl;
+      exit( EXIT_FAILURE );
+    }
+
+    exit( Fleet( fleet, rate ? rate : 1, max_epochs, link_dir ) );
   }
-  catch ( SerialPort::OpenFailed& ex ) {
-    cerr << "Error: Could not open port: " << ex.what() << endl;
-    exit(EXIT_FAILURE);
+
+  // Open the serial port (or pty) for raw 8N1 output
+  //
+  const int serial_fd = HostSerialOpen( ser_device.c_str(), baud, O_WRONLY );
+
+  if ( serial_fd < 0 ) {
+    cerr << "Error: Could not open port " << ser_device << ": "
+         << strerror( errno ) << endl;
+    exit( EXIT_FAILURE );
   }
-  catch ( ... ) {
-    cerr << "Caught unknown exception in SerialPort::Open()"
-            << " in file " << __FILE__
-            << ", line " << __LINE__
-            << " !" << endl;
-    exit(EXIT_FAILURE);
+
+  // replay a recorded file (-s) ...
+  //
+  if ( speed >= 0 ) {
+
+    HostCaptureReader_t capture;
+    int                 status;
+
+    if ( HostCaptureMap( &capture, infile_name.c_str() ) == 0 ) {
+      status = ReplayCapture( serial_fd, &capture, capture_port, start_time,
+                              speed, loop, max_epochs, verbose );
+      HostCaptureUnmap( &capture );
+    }
+    else if ( start_time >= 0 ) {
+      cerr << argv[0] << ": -t needs a capture file (gpstest -c)" << endl;
+      status = EXIT_FAILURE;
+    }
+    else
+      status = Replay( serial_fd, infile_name.c_str(), speed, loop,
+                       max_epochs, verbose );
+
+    close( serial_fd );
+    exit( status );
   }
 
   // open input file if existing ...
@@ -168,7 +1403,7 @@ int main(int argc,char** argv)
 
   if ( !infile_name.empty() ) {
 
-    infile = fopen( infile_name.c_str(), "w" );
+    infile = fopen( infile_name.c_str(), "r" );
 
     if ( !infile )
       cerr << argv[0] << ": could not open NMEA data input file!" << endl;
@@ -180,8 +1415,22 @@ int main(int argc,char** argv)
   list<string> gps_data;
 
   if ( infile ) {  // from file
+    char line[256];
+
+    while ( fgets( line, sizeof(line), infile ) ) {
+
+      line[strcspn( line, "\r\n" )] = 0;
+
+      if ( line[0] == '$' )
+        gps_data.push_back( line );
+    }
+
+    if ( gps_data.empty() )
+      cerr << argv[0] << ": no NMEA data in input file, using default track"
+           << endl;
   }
-  else {           // from default array
+
+  if ( gps_data.empty() ) {  // from default array
     unsigned int i = 0;
 
     while ( gDefaultTrack[i] != NULL ) {
@@ -189,92 +1438,180 @@ int main(int argc,char** argv)
     }
   }
 
+  // the track for -r: the positions of the GPRMC sentences
+
+  vector<TrackPoint> track;
+
+  for ( list<string>::iterator it = gps_data.begin(); it != gps_data.end(); it++ ) {
+
+    TrackPoint point;
+
+    if ( ParsePosition( *it, &point ) ) track.push_back( point );
+  }
+
+  if ( rate && track.empty() ) {
+    cerr << argv[0] << ": no positions (GPRMC) for the epochs" << endl;
+    exit( EXIT_FAILURE );
+  }
+
   // main loop ...
   //
+  // Each period one unit is sent with a single write: a sentence of the
+  // list or (-r) an epoch. The deadlines are absolute, so the rate doesn't
+  // drift; the keyboard is looked at between them.
 
   bool leave = false;
-  bool send = true;
 
   list<string>::iterator gps_iter = gps_data.begin();
-  time_t t0 = time(NULL);
+
+  const long long period = rate ? 1000000000LL / rate : SEND_INTERVAL;
+  long long       start = Now();
+  long long       start_utc = Now( CLOCK_REALTIME );
+
+  if ( rate ) {				// epochs on full (UTC) seconds
+    const long long wait = 1000000000LL - start_utc % 1000000000LL;
+    start += wait;
+    start_utc += wait;
+
+  }
+
+  long long      next = start;
+  long long      next_key = 0;
+  unsigned long  sent = 0, late = 0;
+  unsigned long long bytes = 0;
+  long long      max_late = 0;
+  char           epoch[EPOCH_SIZE];
+
+  if ( rate ) {				// 10 bits per character (8N1)
+    const size_t len = FormatEpoch( epoch, sizeof(epoch), start_utc, track, 0 );
+
+    if ( rate * len * 10 > baud )
+      cerr << argv[0] << ": warning: " << rate << " epochs of " << len
+           << " bytes/s exceed " << baud << " Bd" << endl;
+  }
 
   cout << "You might leave the main loop with 'q' or 'Q' ..." << endl;
 
-  while ( !leave ) {
+  while ( !leave && !( max_epochs && sent >= max_epochs ) ) {
 
-    unsigned char ch;
-    char date_str[10], time_str[10];
-    struct tm *tm;
+    long long now = Now();
 
-    // check if time has elapsed and set 'send' flag eventually
+    if ( now >= next ) {
 
-    if ( (time(NULL) - t0) > 10 ) {
-      send = true;
-    }
+      // deadline reached: send the next unit
 
-    // 'send' flag is set:
-    // - replace time and date fields
-    // - calculate and append checeksum
+      if ( now - next > max_late ) max_late = now - next;
 
-    if ( send ) {
+      size_t len;
 
-      t0 = time(NULL);
-      tm = gmtime( &t0 );
+      if ( rate ) {
+        len = FormatEpoch( epoch, sizeof(epoch), start_utc + ( next - start ),
+                           track, ( next - start ) * 1e-9 );
 
-      string send_str = *gps_iter;
+        if ( verbose ) cout.write( epoch, len );
+      }
+      else {
 
-      sprintf( time_str, "%02d%02d%02d",
-                         tm->tm_hour, tm->tm_min, tm->tm_sec );
-      send_str.replace( send_str.find( "TTTTTT" ), 6, time_str );
+        // - replace time and date fields
+        // - calculate and append checksum
 
-      sprintf( date_str, "%02d%02d%02d",
-                         tm->tm_mday, tm->tm_mon, tm->tm_year - 100 );
-      send_str.replace( send_str.find( "DDDDDD" ), 6, date_str );
+        const time_t t0 = time(NULL);
+        struct tm *tm = gmtime( &t0 );
+        char date_str[32], time_str[32];
 
-      cout << send_str << (int)GetNMEAChecksum(send_str) << endl;
+        string send_str = *gps_iter;
 
-      gps_iter++;
-      if ( gps_iter == gps_data.end() ) gps_iter = gps_data.begin();
+        // recorded sentences are sent as they are
 
-      send = false;
-    }
+        if ( send_str.find( "TTTTTT" ) != string::npos ) {
+          sprintf( time_str, "%02d%02d%02d",
+                             tm->tm_hour, tm->tm_min, tm->tm_sec );
+          send_str.replace( send_str.find( "TTTTTT" ), 6, time_str );
+        }
 
-    if ( kbhit() ) {
+        if ( send_str.find( "DDDDDD" ) != string::npos ) {
+          sprintf( date_str, "%02d%02d%02d",
+                             tm->tm_mday, tm->tm_mon + 1, tm->tm_year % 100 );
+          send_str.replace( send_str.find( "DDDDDD" ), 6, date_str );
+        }
 
-      ch = getch();
+        if ( send_str[send_str.length()-1] == '*' ) {
+          send_str.erase( send_str.length() - 1 );
+          len = AppendSentence( epoch, 0, sizeof(epoch), send_str.c_str() );
+        }
+        else
+          len = snprintf( epoch, sizeof(epoch), "%s\r\n", send_str.c_str() );
 
-      switch ( ch ) {
+        cout.write( epoch, len );
+        cout.flush();
 
-        case 'n':
-        case 'N': cout << endl;
-	          send = true;
-	          break;
+        gps_iter++;
+        if ( gps_iter == gps_data.end() ) gps_iter = gps_data.begin();
+      }
 
-        case 'r':
-        case 'R': cout << endl;
-	          gps_iter = gps_data.begin();
-	          send = true;
-	          break;
+      if ( HostSerialWrite( serial_fd, epoch, len ) < 0 ) {
+        cerr << "Error: Could not write to port: " << strerror( errno ) << endl;
+        break;
+      }
+
+      bytes += len;
+      sent++;
+      next += period;
 
-        case 'q':
-	case 'Q': cout << endl;
-	          leave = 1;
-	          break;
+      now = Now();
+      if ( now - next > period ) {		// the line can't keep up
+        late++;
+        next = now;
       }
+    }
+
+    if ( now >= next_key ) {
+
+      next_key = now + KEY_INTERVAL;
+
+      if ( kbhit() ) {
+
+        const unsigned char ch = getch();
 
-    } // if (kbhit()) ...
+        switch ( ch ) {
 
-    // sleep a while
+          case 'n':
+          case 'N': cout << endl;
+                    next = now;
+                    break;
 
-    usleep( 10 * 1000 );
+          case 'r':
+          case 'R': cout << endl;
+                    gps_iter = gps_data.begin();
+                    next = now;
+                    break;
+
+          case 'q':
+          case 'Q': cout << endl;
+                    leave = 1;
+                    break;
+        }
+
+      } // if (kbhit()) ...
+    }
+
+    // sleep until the next deadline or keyboard check
+
+    SleepUntil( next < next_key ? next : next_key );
 
   } // while (!leave) ...
 
   cout << endl << argv[0] << ": main loop terminating..." << endl;
 
+  const double elapsed = ( Now() - start ) * 1e-9;
+
+  cout << "sent: " << sent << ( rate ? " epochs" : " sentences" )
+       << ", " << bytes << " bytes in " << elapsed << " s, "
+       << late << " late, max. delay " << max_late * 1e-6 << " ms" << endl;
+
   // Close the serial port properly
   //
-  serial_port.Close();
+  close( serial_fd );
 
   if ( infile )
     fclose( infile );
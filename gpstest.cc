@@ -9,15 +9,24 @@
 
 
 #include <iostream>
-#include <sstream>
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>   // getopt() stuff
-
-#include <SerialPort.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <ctime>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
 
 #include "GPS.h"
+#include "HostCapture.h"
+#include "HostLog.h"
+#include "HostQueue.h"
+#include "HostSerial.h"
 #include "LCDDisplay.h"
 
 // --- C prototypes for linked ui.c
@@ -37,8 +46,370 @@ using namespace std;
 static void Usage(const char *pname)
  {
   cerr << "Usage: " << pname << " -p <serial-port> "
-       << "[-i] [-o <outfile>]" << endl << endl;
+       << "[-b <baud>] [-i] [-o <outfile>] [-c <capturefile>]" << endl << endl;
   cerr << "Example: " << pname << " -i -p /dev/ttyS0 -o nmea.dat" << endl;
+  cerr << "         " << pname << " -p /dev/ttyS0 -c nmea.cap" << endl;
+}
+
+// --------------------------------------------------------------------------
+
+static long long Now(void)
+ {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// --------------------------------------------------------------------------
+
+static long PortLost(int fd)
+/*
+ * ABSTRACT:	Characters lost by the serial port so far (overruns of the
+ *		UART and of the driver's buffer), -1 if the port can't tell
+ *		(ptys, USB adapters without the ioctl).
+ */
+ {
+  struct serial_icounter_struct icount;
+
+  if ( ioctl( fd, TIOCGICOUNT, &icount ) < 0 ) return -1;
+
+  return icount.overrun + icount.buf_overrun;
+}
+
+// --------------------------------------------------------------------------
+
+static int EarlierTimeout(int t1, int t2)
+ {
+  if ( t1 < 0 ) return t2;
+  if ( t2 < 0 ) return t1;
+
+  return t1 < t2 ? t1 : t2;
+}
+
+// --------------------------------------------------------------------------
+
+/** Largest chunk read at once, also the size of the text of a record. */
+#define PIPE_CHUNK      1024
+
+/** Number of records in each of the queues, a power of 2. */
+#define PIPE_SLOTS      256
+
+/** A chunk read from the serial port (reader -> parser). */
+struct PipeChunk {
+
+  long long      fTime;                // when it was read, CLOCK_MONOTONIC ns
+  unsigned long  fLost;                // overruns of the port before it
+  unsigned long  fDropped;             // characters dropped before it
+  uint32_t       fLen;                 // characters in fData, 0: end
+  char           fData[PIPE_CHUNK];
+};
+
+/** Types of the output records. */
+enum {
+  kPipeEnd = 0,                        // no more records
+  kPipeText,                           // raw text to be echoed
+  kPipeFix,                            // ... followed by a fix
+  kPipeRaw                             // a chunk as read, for the capture
+};
+
+/** Something to output (parser -> consumer). */
+struct PipeOutput {
+
+  uint32_t       fType;                // kPipeEnd, kPipeText, ...
+  uint32_t       fLen;                 // characters in fData
+  long long      fTime;                // kPipeRaw: see PipeChunk
+  unsigned long  fLost;
+  unsigned long  fDropped;
+  GpsData_t      fFix;                 // kPipeFix: the fix
+  char           fData[PIPE_CHUNK];
+};
+
+/** The stages and the queues in between. */
+struct GpsTestPipe {
+
+  HostQueue_t    fChunks;              // reader -> parser
+  HostQueue_t    fOutput;              // parser -> consumer
+  bool           fCapture;             // forward chunks as kPipeRaw
+
+  // parser
+  char           fText[PIPE_CHUNK];    // text behind the last sentence ...
+  size_t         fTextLen;             // ... that many characters
+  const PipeChunk *fChunk;             // chunk being parsed
+  size_t         fDone;                // ... already in fText or output
+  unsigned long  fStalls;              // output queue was full
+  long long      fLastRead;            // time of the last chunk
+
+  // consumer
+  HostLog_t     *fLog;                 // NMEA data output file (-o), ...
+  HostCapture_t *fCap;                 // capture file (-c), if open
+  int            fDisplayMode;         // switched by any key (reader)
+};
+
+// --------------------------------------------------------------------------
+
+static PipeOutput *OutputSlot(GpsTestPipe *pipe)
+/*
+ * ABSTRACT:	Parser: the next output record. If the consumer lags behind,
+ *		wait for it: the chunk queue buffers meanwhile (backpressure).
+ */
+ {
+  PipeOutput *out;
+
+  while ( !( out = (PipeOutput *)HostQueueSlot( &pipe->fOutput ) ) ) {
+    pipe->fStalls++;
+    HostQueueWaitSpace( &pipe->fOutput, -1 );
+  }
+
+  return out;
+}
+
+// --------------------------------------------------------------------------
+
+static void OutputText(GpsTestPipe *pipe, uint32_t type, const char *ptr,
+                       size_t len, bool fix)
+/*
+ * ABSTRACT:	Parser: output the pending text plus 'len' characters of
+ *		'ptr' (at most PIPE_CHUNK), with the current fix if 'fix' is
+ *		set. If all of it doesn't fit, the pending text goes first.
+ */
+ {
+  if ( pipe->fTextLen + len > PIPE_CHUNK ) {
+    PipeOutput *out = OutputSlot( pipe );
+
+    out->fType = kPipeText;
+    out->fLen = pipe->fTextLen;
+    memcpy( out->fData, pipe->fText, pipe->fTextLen );
+    HostQueuePush( &pipe->fOutput );
+
+    pipe->fTextLen = 0;
+  }
+
+  PipeOutput *out = OutputSlot( pipe );
+
+  out->fType = type;
+  out->fLen = pipe->fTextLen + len;
+  memcpy( out->fData, pipe->fText, pipe->fTextLen );
+  memcpy( out->fData + pipe->fTextLen, ptr, len );
+
+  if ( fix )
+    GpsMsgPrepareData( &out->fFix );
+
+  HostQueuePush( &pipe->fOutput );
+
+  pipe->fTextLen = 0;
+}
+
+// --------------------------------------------------------------------------
+
+static void SentenceDone(GpsParser_t *parser, size_t offset, void *arg)
+/*
+ * ABSTRACT:	Called by GpsMsgParseBuffer() for each complete epoch,
+ *		'offset' is behind the '\n' of its last sentence in the chunk:
+ *		output the raw text up to there together with the fix.
+ */
+ {
+  GpsTestPipe *pipe = (GpsTestPipe *)arg;
+
+  (void)parser;
+
+  OutputText( pipe, kPipeFix, pipe->fChunk->fData + pipe->fDone,
+              offset - pipe->fDone, true );
+
+  pipe->fDone = offset;
+}
+
+// --------------------------------------------------------------------------
+
+static void EpochTimeout(GpsTestPipe *pipe)
+/*
+ * ABSTRACT:	Parser: the port is silent (or closed), output the fix of
+ *		the current epoch if it is still pending.
+ */
+ {
+  if ( GpsMsgTimeout() != kTRUE ) return;
+
+  PipeOutput *out = OutputSlot( pipe );
+
+  out->fType = kPipeFix;
+  out->fLen = 0;
+  GpsMsgPrepareData( &out->fFix );
+  HostQueuePush( &pipe->fOutput );
+}
+
+// --------------------------------------------------------------------------
+
+static void *Parser(void *arg)
+/*
+ * ABSTRACT:	The parser stage: decode the chunks of the reader, pass the
+ *		text and fixes (and with -c the chunks) to the consumer.
+ */
+ {
+  GpsTestPipe *pipe = (GpsTestPipe *)arg;
+
+  for (;;) {
+
+    const PipeChunk *chunk;
+
+    while ( !( chunk = (const PipeChunk *)HostQueueFront( &pipe->fChunks ) ) ) {
+
+      const long long silent = ( Now() - pipe->fLastRead ) / 1000000;
+
+      if ( silent < GPS_EPOCH_TIMEOUT )
+        HostQueueWaitData( &pipe->fChunks, GPS_EPOCH_TIMEOUT - silent );
+      else {
+        EpochTimeout( pipe );
+        HostQueueWaitData( &pipe->fChunks, -1 );
+      }
+    }
+
+    if ( !chunk->fLen ) break;			// end of the stream
+
+    pipe->fLastRead = chunk->fTime;
+
+    if ( pipe->fCapture ) {
+      PipeOutput *out = OutputSlot( pipe );
+
+      out->fType = kPipeRaw;
+      out->fLen = chunk->fLen;
+      out->fTime = chunk->fTime;
+      out->fLost = chunk->fLost;
+      out->fDropped = chunk->fDropped;
+      memcpy( out->fData, chunk->fData, chunk->fLen );
+      HostQueuePush( &pipe->fOutput );
+    }
+
+    pipe->fChunk = chunk;
+    pipe->fDone = 0;
+
+    GpsMsgParseBuffer( chunk->fData, chunk->fLen, SentenceDone, pipe );
+
+    // keep the rest for the next sentence, output it if it gets too long
+
+    const size_t rest = chunk->fLen - pipe->fDone;
+
+    if ( pipe->fTextLen + rest > PIPE_CHUNK )
+      OutputText( pipe, kPipeText, chunk->fData + pipe->fDone, rest, false );
+    else {
+      memcpy( pipe->fText + pipe->fTextLen, chunk->fData + pipe->fDone, rest );
+      pipe->fTextLen += rest;
+    }
+
+    HostQueuePop( &pipe->fChunks );
+  }
+
+  HostQueuePop( &pipe->fChunks );
+
+  EpochTimeout( pipe );
+
+  if ( pipe->fTextLen )				// an incomplete last line
+    OutputText( pipe, kPipeText, "", 0, false );
+
+  OutputSlot( pipe )->fType = kPipeEnd;
+  HostQueuePush( &pipe->fOutput );
+
+  return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+static void Echo(GpsTestPipe *pipe, const char *ptr, size_t len)
+ {
+  cout.write( ptr, len );
+
+  HostLogWrite( pipe->fLog, ptr, len );		// if open
+}
+
+// --------------------------------------------------------------------------
+
+static void *Consumer(void *arg)
+/*
+ * ABSTRACT:	The output stage: echo and log the text, show the fixes,
+ *		write the capture. The only thread using gGpsData, cout and
+ *		the output files.
+ */
+ {
+  GpsTestPipe *pipe = (GpsTestPipe *)arg;
+
+  for (;;) {
+
+    const PipeOutput *out =
+      (const PipeOutput *)HostQueueFront( &pipe->fOutput );
+
+    if ( !out ) {
+
+      // nothing to do: write the logs when due, wait for more
+
+      cout.flush();
+
+      HostLogTick( pipe->fLog );
+      HostLogTick( &pipe->fCap->fLog );
+
+      HostQueueWaitData( &pipe->fOutput,
+                         EarlierTimeout( HostLogTimeout( pipe->fLog ),
+                                         HostLogTimeout( &pipe->fCap->fLog ) ) );
+      continue;
+    }
+
+    if ( out->fType == kPipeEnd ) break;
+
+    if ( out->fType == kPipeRaw ) {
+
+      if ( out->fDropped )
+        HostCaptureLost( pipe->fCap, 0, out->fTime, out->fDropped );
+      if ( out->fLost )
+        HostCaptureLost( pipe->fCap, 0, out->fTime, out->fLost );
+
+      HostCaptureData( pipe->fCap, 0, out->fTime, out->fData, out->fLen );
+    }
+    else
+      Echo( pipe, out->fData, out->fLen );
+
+    if ( out->fType == kPipeFix ) {
+
+      GpsMsgPublish( &out->fFix );
+
+      if ( GpsDataIsComplete( &gGpsData ) ) {
+
+        GpsMsgShow();
+
+        LcdDisplayShow();
+
+        GpsDataClear( &gGpsData );
+      }
+
+      // switch display mode from time to time (AVR: done via push button)
+      //
+
+      switch ( __atomic_load_n( &pipe->fDisplayMode, __ATOMIC_RELAXED ) ) {
+        case 0: LcdDisplaySetMode( kTimeLocator );
+                break;
+
+        case 2: LcdDisplaySetMode( kLatLon );
+                break;
+
+        case 3: LcdDisplaySetMode( kLocatorAltitude );
+                break;
+
+        case 4: LcdDisplaySetMode( kSpeedRoute );
+                break;
+
+        case 5: LcdDisplaySetMode( kDOP );
+                break;
+
+        default: LcdDisplaySetMode( kDateTime );
+      }
+    }
+
+    HostQueuePop( &pipe->fOutput );
+  }
+
+  HostQueuePop( &pipe->fOutput );
+
+  cout.flush();
+
+  return NULL;
 }
 
 // --------------------------------------------------------------------------
@@ -53,6 +424,7 @@ static const char * gInitSequence[] = {
 //
 // run with:
 //  ./gpstest -p /dev/ttyUSB0
+//  ./gpstest -b 115200 -p /dev/ttyUSB0
 //
 
 int main(int argc,char** argv)
@@ -65,14 +437,16 @@ int main(int argc,char** argv)
   // --- read application parameters from the cmd line
 
   string outfile_name;
+  string capfile_name;
   string ser_device;
+  unsigned long baud = 4800;
   bool do_init = false;
 
   int getopt_status;
 
   do {
 
-    getopt_status = getopt( argc, argv, "ip:o:?" );
+    getopt_status = getopt( argc, argv, "b:c:ip:o:?" );
 
     if ( getopt_status == EOF ) break;
 
@@ -82,6 +456,12 @@ int main(int argc,char** argv)
 
     switch ( getopt_status ) {
 
+      case 'b': baud = strtoul( optarg, NULL, 10 );
+        	break;
+
+      case 'c': capfile_name = optarg;
+        	break;
+
       case 'i': do_init = true;
         	break;
 
@@ -101,32 +481,13 @@ int main(int argc,char** argv)
 
   } while ( getopt_status != EOF );
 
-  // Open the serial port.
+  // Open the serial port (non-blocking, read by the epoll loop below)
   //
-  SerialPort serial_port( ser_device );
+  const int serial_fd = HostSerialOpen( ser_device.c_str(), baud, O_RDWR );
 
-  // Set communication parameters & open the port, catch exceptions
-  //
-  try {
-    serial_port.Open( SerialPort::BAUD_4800,
-		      SerialPort::CHAR_SIZE_8,
-		      SerialPort::PARITY_NONE,
-		      SerialPort::STOP_BITS_1,
-		      SerialPort::FLOW_CONTROL_NONE );
-  }
-  catch ( SerialPort::AlreadyOpen& ex ) {
-    cerr << "Error: Port is already open: " << ex.what() << endl;
-    exit(EXIT_FAILURE);
-  }
-  catch ( SerialPort::OpenFailed& ex ) {
-    cerr << "Error: Could not open port: " << ex.what() << endl;
-    exit(EXIT_FAILURE);
-  }
-  catch ( ... ) {
-    cerr << "Caught unknown exception in SerialPort::Open()"
-            << " in file " << __FILE__
-            << ", line " << __LINE__
-            << " !" << endl;
+  if ( serial_fd < 0 ) {
+    cerr << "Error: Could not open port " << ser_device << ": "
+         << strerror( errno ) << endl;
     exit(EXIT_FAILURE);
   }
 
@@ -135,39 +496,19 @@ int main(int argc,char** argv)
 
   if ( do_init ) {
 
-    ostringstream msg;
-    unsigned char checksum;
-
     for ( unsigned int i=0; i<sizeof(gInitSequence)/sizeof(char *); i++ ) {
 
-      msg.str( gInitSequence[i] );
+      char msg[80];
+      unsigned char checksum = 0;
 
-      checksum = 0;
-      for ( unsigned int s=0; s<strlen(gInitSequence[i]); s++ )
+      for ( unsigned int s=1; s<strlen(gInitSequence[i]); s++ )
         checksum ^= gInitSequence[i][s];
 
-      msg << '*';
-      msg << hex << checksum << dec;
-      msg << '\r';
-      msg << '\n';
+      snprintf( msg, sizeof(msg), "%s*%02X\r\n", gInitSequence[i], checksum );
 
-      try {
-        serial_port.Write( msg.str() );
-      }
-      catch ( SerialPort::NotOpen& ex ) {
-        cerr << "Error: Port is not open: " << ex.what() << endl;
-        exit( EXIT_FAILURE );;
-      }
-      catch ( std::exception& ex ) {
-        cerr << "Error: RunTime error: " << ex.what() << endl;
-        exit( EXIT_FAILURE );;
-      }
-      catch (...) {
-        cerr << "Caught unknown exception in SerialPort::Write()"
-             << " in file " << __FILE__
-             << ", line " << __LINE__
-             << " !" << endl;
-        exit(EXIT_FAILURE);
+      if ( HostSerialWrite( serial_fd, msg, strlen(msg) ) < 0 ) {
+        cerr << "Error: Could not write to port: " << strerror( errno ) << endl;
+        exit( EXIT_FAILURE );
       }
     }
   }
@@ -178,111 +519,219 @@ int main(int argc,char** argv)
 
   LcdDisplaySetMode( kDateTime );
 
-  // main loop ...
+  static GpsTestPipe pipe;
+  static HostLog_t   nmea_log;
+
+  nmea_log.fFd = -1;				// not open
+  pipe.fLog = &nmea_log;
+
+  if ( !outfile_name.empty() &&
+       HostLogOpen( &nmea_log, outfile_name.c_str(), 0 ) < 0 )
+    cerr << argv[0] << ": could not open NMEA data output file!" << endl;
+
+  // raw capture with the time of each read (-c)
+
+  static HostCapture_t capture;
+  long                 port_lost = -1;
+
+  capture.fLog.fFd = -1;			// not open
+  pipe.fCap = &capture;
+
+  if ( !capfile_name.empty() ) {
+
+    if ( HostCaptureOpen( &capture, capfile_name.c_str() ) < 0 )
+      cerr << argv[0] << ": could not open capture file "
+           << capfile_name << ": " << strerror( errno ) << endl;
+    else {
+      HostCapturePort( &capture, 0, ser_device.c_str(), baud );
+      port_lost = PortLost( serial_fd );
+      pipe.fCapture = true;
+    }
+  }
+
+  // the pipeline: this thread reads, the others parse and output, so a
+  // slow terminal or disk never delays reading
   //
+  if ( HostQueueInit( &pipe.fChunks, PIPE_SLOTS, sizeof(PipeChunk) ) < 0 ||
+       HostQueueInit( &pipe.fOutput, PIPE_SLOTS, sizeof(PipeOutput) ) < 0 ) {
+    cerr << "Error: Could not allocate the queues" << endl;
+    exit( EXIT_FAILURE );
+  }
 
-  bool leave = false;
+  // wait for the serial port and the keyboard, the latter in non-canonical
+  // mode as a key press shall wake us up (kbhit() and getch() keep it)
+  //
+  const int epoll_fd = epoll_create1( 0 );
+  struct epoll_event event;
 
-  cout << "You might leave the main loop with 'q' or 'Q' ..." << endl;
+  if ( epoll_fd < 0 ) {
+    cerr << "Error: epoll_create1(): " << strerror( errno ) << endl;
+    exit( EXIT_FAILURE );
+  }
 
-  ostringstream gps_msg;
-  int display_mode = 0;
+  event.events = EPOLLIN;
+  event.data.fd = serial_fd;
+  epoll_ctl( epoll_fd, EPOLL_CTL_ADD, serial_fd, &event );
+
+  int tty_fd = open( "/dev/tty", O_RDWR | O_NOCTTY );
+  struct termios tty_mode;
+
+  if ( tty_fd >= 0 && tcgetattr( tty_fd, &tty_mode ) < 0 ) {
+    close( tty_fd );				// no terminal: no keyboard
+    tty_fd = -1;
+  }
 
-  FILE * outfile = NULL;
+  if ( tty_fd >= 0 ) {
 
-  if ( !outfile_name.empty() ) {
+    struct termios cur_mode = tty_mode;
 
-    outfile = fopen( outfile_name.c_str(), "w" );
+    cur_mode.c_lflag &= ~(ICANON | ECHO);
+    cur_mode.c_cc[VTIME] = 0;
+    cur_mode.c_cc[VMIN] = 1;
+    tcsetattr( tty_fd, TCSANOW, &cur_mode );
 
-    if ( !outfile )
-      cerr << argv[0] << ": could not open NMEA data output file!" << endl;
+    event.events = EPOLLIN;
+    event.data.fd = tty_fd;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, tty_fd, &event );
   }
 
-  while ( !leave ) {
+  cout << "You might leave the main loop with 'q' or 'Q' ..." << endl;
 
-    unsigned char ch, data;
+  pthread_t parser, consumer;
 
-    if ( serial_port.IsDataAvailable() ) {
+  if ( pthread_create( &consumer, NULL, Consumer, &pipe ) ||
+       pthread_create( &parser, NULL, Parser, &pipe ) ) {
+    cerr << "Error: Could not start the pipeline threads" << endl;
+    exit( EXIT_FAILURE );
+  }
 
-      data = serial_port.ReadByte( 0 );
+  // main loop (reader) ...
+  //
 
-      gps_msg << data;
+  bool               leave = false;
+  unsigned long      lost = 0, dropped = 0, dropped_chunks = 0;
+  unsigned long long bytes = 0;
+  char               scratch[PIPE_CHUNK];
 
-      if ( GpsMsgHandler( data ) == kTRUE ) {
+  while ( !leave ) {
 
-        if ( outfile ) {
-	  fprintf( outfile, "%s", gps_msg.str().c_str() );
-	  fflush( outfile );
-	}
+    struct epoll_event events[2];
 
-        cout << gps_msg.str();
-	gps_msg.str("");
+    const int nevents = epoll_wait( epoll_fd, events, 2, -1 );
 
-        GpsMsgPrepare();
+    if ( nevents < 0 && errno != EINTR ) {
+      cerr << "Error: epoll_wait(): " << strerror( errno ) << endl;
+      break;
+    }
 
-	if ( GpsDataIsComplete( &gGpsData ) ) {
+    for ( int e=0; e<nevents; e++ ) {
 
-	  GpsMsgShow();
+      if ( events[e].data.fd == serial_fd ) {
 
-	  LcdDisplayShow();
+        // read into the next free chunk, if the parser lags behind so far
+        // that there is none, read anyway and drop the characters
 
-	  GpsDataClear( &gGpsData );
-	}
+        PipeChunk *chunk = (PipeChunk *)HostQueueSlot( &pipe.fChunks );
 
-	// switch display mode from time to time (AVR: done via push button)
-	//
+        const ssize_t len = HostSerialRead( serial_fd,
+                                            chunk ? chunk->fData : scratch,
+                                            PIPE_CHUNK );
 
-	switch ( display_mode ) {
-	  case 0: LcdDisplaySetMode( kTimeLocator );
-	          break;
+        if ( len < 0 ) {
+          cerr << argv[0] << ": serial port closed" << endl;
+          leave = true;
+          break;
+        }
 
-	  case 2: LcdDisplaySetMode( kLatLon );
-	          break;
+        bytes += len;
 
-	  case 3: LcdDisplaySetMode( kLocatorAltitude );
-	          break;
+        if ( port_lost >= 0 ) {
+          const long now_lost = PortLost( serial_fd );
 
-	  case 4: LcdDisplaySetMode( kSpeedRoute );
-	          break;
+          if ( now_lost > port_lost ) lost += now_lost - port_lost;
+          port_lost = now_lost;
+        }
 
-	  case 5: LcdDisplaySetMode( kDOP );
-	          break;
+        if ( !len ) continue;
 
-	  default: LcdDisplaySetMode( kDateTime );
-	}
-      }
+        if ( !chunk ) {
+          dropped += len;
+          dropped_chunks++;
+          continue;
+        }
 
-    } // if ( serial_port.IsDataAvailable() )
-    else {
-      usleep( 10 * 1000 ); // 10 msec, chars every 2 msec @ 4800 Bd
-    }
+        chunk->fTime = Now();
+        chunk->fLen = len;
+        chunk->fLost = lost;
+        chunk->fDropped = dropped;
+        HostQueuePush( &pipe.fChunks );
 
-    if ( kbhit() ) {
+        lost = dropped = 0;
 
-      ch = getch();
+      } // if ( events[e].data.fd == serial_fd )
+      else if ( kbhit() ) {
 
-      switch ( ch ) {
+        unsigned char ch = getch();
 
-        case 'q':
-	case 'Q': leave = 1;
-	          break;
+        switch ( ch ) {
 
-	default:  display_mode++;
-	          display_mode %= 6;
-      }
+          case 'q':
+          case 'Q': leave = 1;
+                    break;
+
+          default:  __atomic_store_n( &pipe.fDisplayMode,
+                                      ( pipe.fDisplayMode + 1 ) % 6,
+                                      __ATOMIC_RELAXED );
+        }
 
-    } // if (kbhit()) ...
+      } // if (kbhit()) ...
+    }
 
   } // while (!leave) ...
 
+  // end of the stream: let the pipeline drain
+
+  PipeChunk *chunk;
+
+  while ( !( chunk = (PipeChunk *)HostQueueSlot( &pipe.fChunks ) ) )
+    HostQueueWaitSpace( &pipe.fChunks, -1 );
+
+  chunk->fLen = 0;
+  HostQueuePush( &pipe.fChunks );
+
+  pthread_join( parser, NULL );
+  pthread_join( consumer, NULL );
+
   cout << endl << argv[0] << ": main loop terminating..." << endl;
 
+  if ( tty_fd >= 0 ) {
+    tcsetattr( tty_fd, TCSANOW, &tty_mode );
+    close( tty_fd );
+  }
+
+  close( epoll_fd );
+
   // Close the serial port properly
   //
-  serial_port.Close();
+  close( serial_fd );
+
+  HostLogClose( &nmea_log );
+
+  if ( capture.fLog.fFd >= 0 ) {
+    HostCaptureClose( &capture );
+    cerr << argv[0] << ": " << capture.fBytes << " characters in "
+         << capture.fRecords << " records captured" << endl;
+  }
+
+  if ( dropped_chunks || pipe.fStalls )
+    cerr << argv[0] << ": " << bytes << " characters read, "
+         << dropped_chunks << " chunks dropped (parser behind), "
+         << pipe.fStalls << " parser stalls (output behind), queues "
+         << pipe.fChunks.fMaxUsed << "/" << PIPE_SLOTS << " and "
+         << pipe.fOutput.fMaxUsed << "/" << PIPE_SLOTS << " at most" << endl;
 
-  if ( outfile )
-    fclose( outfile );
+  HostQueueFree( &pipe.fChunks );
+  HostQueueFree( &pipe.fOutput );
 
   exit(EXIT_SUCCESS);
 }
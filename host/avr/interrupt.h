@@ -0,0 +1,38 @@
+/*
+ * File   : host/avr/interrupt.h
+ *
+ * Purpose: Interrupts of the firmware built on the host.
+ *
+ * $Id$
+ */
+
+#ifndef _host_avr_interrupt_h_
+#define _host_avr_interrupt_h_
+
+/** @file host/avr/interrupt.h
+  * An ISR is an ordinary function, HostHal.c calls it while the I bit of
+  * SREG is set (between two passes of the main loop, see HostHal.h).
+  * @author
+  */
+
+#include <avr/io.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define ISR(vector)     void vector(void)
+
+#define sei()           (SREG |= (1<<SREG_I))
+#define cli()           (SREG &= ~(1<<SREG_I))
+
+/* the vectors the firmware uses */
+extern void USART_RXC_vect(void);
+extern void USART_TXC_vect(void);
+extern void TIMER1_OVF_vect(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _host_avr_interrupt_h_ */
@@ -0,0 +1,102 @@
+/*
+ * File   : host/avr/io.h
+ *
+ * Purpose: atmega8 I/O registers for the firmware built on the host.
+ *
+ * $Id$
+ */
+
+#ifndef _host_avr_io_h_
+#define _host_avr_io_h_
+
+/** @file host/avr/io.h
+  * The registers used by the GPSDisplay firmware as plain variables, defined
+  * and driven by HostHal.c. Only what the firmware needs is here.
+  *
+  * UDR is wider than on the AVR: HostHal.c keeps HOST_UDR_EMPTY in it and
+  * so notices when the firmware writes a character.
+  * @author
+  */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define HOST_UDR_EMPTY  0x100
+
+extern volatile uint8_t  SREG;
+
+extern volatile uint8_t  DDRB, PORTB, PINB;
+extern volatile uint8_t  DDRC, PORTC, PINC;
+extern volatile uint8_t  DDRD, PORTD, PIND;
+
+extern volatile uint16_t UDR;
+extern volatile uint8_t  UCSRA, UCSRB, UCSRC, UBRRH, UBRRL;
+
+extern volatile uint16_t TCNT1;
+extern volatile uint8_t  TCCR1A, TCCR1B, TIMSK;
+
+/* SREG */
+#define SREG_I  7
+
+/* ports */
+#define PB0     0
+#define PB1     1
+#define PB2     2
+#define PB3     3
+#define PB4     4
+#define PB5     5
+#define PB6     6
+#define PB7     7
+
+#define PC0     0
+#define PC1     1
+#define PC2     2
+#define PC3     3
+#define PC4     4
+#define PC5     5
+#define PC6     6
+
+#define PD0     0
+#define PD1     1
+#define PD2     2
+#define PD3     3
+#define PD4     4
+#define PD5     5
+#define PD6     6
+#define PD7     7
+
+/* UCSRA */
+#define RXC     7
+#define TXC     6
+#define UDRE    5
+#define FE      4
+#define DOR     3
+
+/* UCSRB */
+#define RXCIE   7
+#define TXCIE   6
+#define UDRIE   5
+#define RXEN    4
+#define TXEN    3
+
+/* UCSRC */
+#define URSEL   7
+#define UCSZ1   2
+#define UCSZ0   1
+
+/* TCCR1B */
+#define CS12    2
+#define CS11    1
+#define CS10    0
+
+/* TIMSK */
+#define TOIE1   2
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _host_avr_io_h_ */
@@ -0,0 +1,27 @@
+/*
+ * File   : host/avr/pgmspace.h
+ *
+ * Purpose: Program memory access for the firmware built on the host.
+ *
+ * $Id$
+ */
+
+#ifndef _host_avr_pgmspace_h_
+#define _host_avr_pgmspace_h_
+
+/** @file host/avr/pgmspace.h
+  * There is only one address space on the host, flash is ordinary memory.
+  * @author
+  */
+
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P                           const char *
+#define PSTR(_s)                        (_s)
+
+#define pgm_read_byte(_addr)            (*(const unsigned char *)(_addr))
+#define strlen_P(_s)                    strlen(_s)
+#define memcpy_P(_dest,_src,_size)      memcpy(_dest,_src,_size)
+
+#endif /* _host_avr_pgmspace_h_ */
@@ -0,0 +1,22 @@
+/*
+ * File   : host/util/delay.h
+ *
+ * Purpose: Busy waiting of the firmware built on the host.
+ *
+ * $Id$
+ */
+
+#ifndef _host_util_delay_h_
+#define _host_util_delay_h_
+
+/** @file host/util/delay.h
+  * A delay doesn't wait, it advances the simulated clock of HostHal.c.
+  * @author
+  */
+
+#include "HostHal.h"
+
+#define _delay_us(_us)  HostHalDelay( (unsigned long)(_us) )
+#define _delay_ms(_ms)  HostHalDelay( (unsigned long)(_ms) * 1000UL )
+
+#endif /* _host_util_delay_h_ */
@@ -0,0 +1,598 @@
+
+//
+// File   : nmea-replay.cc
+//
+// Purpose: Program which feeds recorded NMEA data files through the GPS.c
+//          parser as fast as possible and reports the throughput
+//
+// $Id$
+//
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>   // getopt() stuff
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "GPS.h"
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
+
+static void Usage(const char *pname)
+ {
+  cerr << "Usage: " << pname << " [-r <repeat>] [-j <threads>] "
+       << "[-o <outfile>] <nmea-file> ..." << endl << endl;
+  cerr << "Example: " << pname << " -j 8 -o fixes.csv archive.dat" << endl
+       << endl;
+  cerr << "With -j > 1 the fixes of the parts of a file are merged by date "
+       << "and time, the" << endl
+       << "output is the same as with -j 1 only for files in time order."
+       << endl;
+}
+
+// --------------------------------------------------------------------------
+
+/** Characters parsed in front of a shard to rebuild the parser state.
+  *
+  * The fields of a fix come from different sentences (GPRMC, GPGGA, ...),
+  * so a parser starting in the middle of a file needs to see the sentences
+  * of (at least) one epoch first, their fixes are not reported.
+  */
+#define REPLAY_WARM_UP  4096
+
+/** Characters parsed by each thread per round: a file is parsed in rounds
+  * of one window per thread, the fixes of a round are merged and written
+  * before the next one starts (see ShardSplit()). Thus only the fixes of
+  * one round are kept in memory.
+  */
+#define REPLAY_WINDOW   ( 64UL << 20 )
+
+/** Counters of one replay run. */
+struct ReplayStats {
+
+  unsigned long long  fBytes;          // characters fed into the parser
+  unsigned long long  fEpochs;         // completed epochs
+  unsigned long long  fRejected;       // sentences dropped by the parser
+  unsigned long long  fFixes;          // ... of them with valid position
+};
+
+/** A fix as merged into the output: sort key and its formatted line. */
+struct ShardFix {
+
+  unsigned long long  fKey;            // date and time, see FixKey()
+  size_t              fLine;           // offset of the line in fText
+};
+
+/** One part of a round, parsed by a thread of its own. */
+struct Shard {
+
+  const char         *fBuf;            // the mapped file
+  size_t              fWarm;           // warm-up starts here, ...
+  size_t              fStart;          // ... the shard itself here
+  size_t              fEnd;            // behind the shard's last '\n'
+  bool                fOutput;         // format the fixes ?
+  bool                fResume;         // continues the previous shard ?
+  bool                fWarmUp;         // in the warm-up part ?
+  unsigned long long  fLastKey;        // of the previous fix
+
+  GpsParser_t         fParser;
+  ReplayStats         fStats;
+  vector<ShardFix>    fFixes;
+  string              fText;           // all lines of fFixes
+};
+
+// --------------------------------------------------------------------------
+
+static double Now(void)
+ {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// --------------------------------------------------------------------------
+
+#ifndef APRS
+/** Does 'date' hold a DDMMYY date (not set before the first GPRMC) ? */
+static bool DateIsKnown(const char *date)
+ {
+  for ( int i=0; i<6; i++ )
+    if ( date[i] < '0' || date[i] > '9' )
+      return false;
+
+  return true;
+}
+#endif /* APRS */
+
+// --------------------------------------------------------------------------
+
+static unsigned long long FixKey(const GpsData_t *data,
+                                 unsigned long long last)
+/*
+ * ABSTRACT:	Sort key of a fix: UTC date (days since 2000) and time of the
+ *		day in ms. Fixes without date (all of them for APRS) get 0,
+ *		i.e. they stay in the order of the file.
+ *
+ *		Sentences without date field (GPGGA) carry the one of the
+ *		last GPRMC, which is one day behind right after midnight: a
+ *		time more than 12 hours before the previous fix's is taken
+ *		as the next day.
+ */
+ {
+#ifndef APRS
+  const char *date = data->fDate;
+
+  if ( !DateIsKnown( date ) ) return 0;
+
+  static const unsigned short kDays[12] = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+  };
+
+  const unsigned int dd = (date[0] - '0') * 10 + (date[1] - '0');
+  const unsigned int mm = (date[2] - '0') * 10 + (date[3] - '0');
+  const unsigned int yy = (date[4] - '0') * 10 + (date[5] - '0');
+
+  if ( mm < 1 || mm > 12 ) return 0;
+
+  const unsigned long long day = yy * 365 + (yy + 3) / 4 + kDays[mm-1] + dd
+                               + ( mm > 2 && yy % 4 == 0 ? 1 : 0 );
+
+  unsigned long long key = day * 86400000ULL + data->fFix.fTime;
+
+  if ( key + 43200000ULL < last )		// midnight passed
+    key += 86400000ULL;
+
+  return key;
+#else
+  (void)data;
+  (void)last;
+
+  return 0;
+#endif /* APRS */
+}
+
+// --------------------------------------------------------------------------
+
+static void FormatFix(const GpsData_t *data, string *text)
+/*
+ * ABSTRACT:	Append one line of the output file, see the header written
+ *		in main().
+ */
+ {
+  char line[128];
+  const GpsFix_t *fix = &data->fFix;
+
+  snprintf( line, sizeof(line),
+            "%.6s,%lu,%ld,%ld,%ld,%u,%u,%u,%u,%d\n",
+#ifndef APRS
+            DateIsKnown( data->fDate ) ? data->fDate : "",
+#else
+            "",
+#endif /* APRS */
+            (unsigned long)fix->fTime, (long)fix->fLatitude,
+            (long)fix->fLongitude, (long)fix->fAltitude,
+            fix->fSpeed, fix->fCourse, fix->fSatellites,
+#ifndef APRS
+            fix->fHDOP,
+#else
+            0,
+#endif /* APRS */
+            GpsDataIsValid( data ) );
+
+  text->append( line );
+}
+
+// --------------------------------------------------------------------------
+
+static void SentenceDone(GpsParser_t *parser, size_t offset, void *arg)
+ {
+  Shard     *shard = (Shard *)arg;
+  GpsData_t  data;
+
+  (void)offset;
+
+  GpsParserPrepare( parser, &data );		// also updates the parser
+
+  if ( shard->fOutput )
+    shard->fLastKey = FixKey( &data, shard->fLastKey );
+
+  if ( shard->fWarmUp ) return;
+
+  if ( GpsDataIsValid( &data ) )
+    shard->fStats.fFixes++;
+
+  if ( shard->fOutput ) {
+
+    ShardFix fix;
+
+    fix.fKey  = shard->fLastKey;
+    fix.fLine = shard->fText.size();
+
+    shard->fFixes.push_back( fix );
+    FormatFix( &data, &shard->fText );
+  }
+}
+
+// --------------------------------------------------------------------------
+
+static size_t ShardParse(Shard *shard, size_t from, size_t to)
+/*
+ * ABSTRACT:	Parse the characters fBuf[from] ... fBuf[to-1] of a shard
+ *		window by window, the parser carries a sentence over to the
+ *		next one. Returns the number of completed epochs.
+ */
+ {
+  size_t epochs = 0;
+
+  while ( from < to ) {
+
+    const size_t len = to - from < REPLAY_WINDOW ? to - from : REPLAY_WINDOW;
+
+    epochs += GpsParserParse( &shard->fParser, shard->fBuf + from, len,
+                              SentenceDone, shard );
+    from += len;
+  }
+
+  return epochs;
+}
+
+// --------------------------------------------------------------------------
+
+static void *ShardRun(void *arg)
+/*
+ * ABSTRACT:	Parse a shard: the warm-up part without reporting anything,
+ *		then the shard itself. A shard continuing the one parsed
+ *		before needs no warm-up, its parser goes on.
+ */
+ {
+  Shard *shard = (Shard *)arg;
+
+  if ( !shard->fResume ) {
+
+    GpsParserInit( &shard->fParser );
+
+    shard->fWarmUp = true;
+    shard->fLastKey = 0;
+
+    ShardParse( shard, shard->fWarm, shard->fStart );
+  }
+
+  shard->fWarmUp = false;
+  shard->fParser.fRejected = 0;
+
+  shard->fStats.fEpochs = ShardParse( shard, shard->fStart, shard->fEnd );
+  shard->fStats.fRejected = shard->fParser.fRejected;
+  shard->fStats.fBytes = shard->fEnd - shard->fStart;
+
+  return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+static size_t LineStart(const char *buf, size_t len, size_t pos)
+/*
+ * ABSTRACT:	Position of the first line starting at or after 'pos'.
+ */
+ {
+  if ( pos == 0 ) return 0;
+
+  const void *eol = memchr( buf + pos - 1, '\n', len - pos + 1 );
+
+  return eol ? (const char *)eol - buf + 1 : len;
+}
+
+// --------------------------------------------------------------------------
+
+static size_t ShardSplit(vector<Shard> &shards, const char *buf, size_t len,
+                         size_t from, bool output)
+/*
+ * ABSTRACT:	Split the next round of 'buf', which starts at 'from', into
+ *		shards of about the same size, all of them starting at the
+ *		beginning of a line: no sentence straddles two shards. A
+ *		round is REPLAY_WINDOW characters per shard, or the rest of
+ *		'buf'. Returns the end of the round.
+ */
+ {
+  const size_t count = shards.size();
+  const size_t size = len - from < count * REPLAY_WINDOW ? len - from
+                                                        : count * REPLAY_WINDOW;
+  const size_t to = from + size < len ? LineStart( buf, len, from + size ) : len;
+
+  for ( size_t i=0; i<count; i++ ) {
+
+    Shard *shard = &shards[i];
+    const size_t start = i ? LineStart( buf, len, from + size / count * i )
+                           : from;
+
+    shard->fResume = from && shard->fEnd == start;
+
+    shard->fBuf    = buf;
+    shard->fStart  = start;
+    shard->fEnd    = i + 1 < count ? LineStart( buf, len,
+                                                from + size / count * (i+1) )
+                                   : to;
+    shard->fWarm   = shard->fStart > REPLAY_WARM_UP ?
+                       LineStart( buf, len, shard->fStart - REPLAY_WARM_UP ) : 0;
+    shard->fOutput = output;
+
+    memset( &shard->fStats, 0, sizeof(shard->fStats) );
+    shard->fFixes.clear();
+    shard->fText.clear();
+  }
+
+  return to;
+}
+
+// --------------------------------------------------------------------------
+
+static void ShardMerge(vector<Shard> &shards, FILE *outfile)
+/*
+ * ABSTRACT:	Write the fixes of all shards ordered by date and time. The
+ *		order of fixes with the same time stamp is kept, i.e. a file
+ *		in time order comes out as if parsed by a single thread.
+ *
+ *		Only the next fixes of the shards are compared, the fixes of
+ *		a shard stay in the order of the file: if that is not in
+ *		time order, the output is neither sorted nor the same as
+ *		with a single shard (see ShardsInOrder()).
+ */
+ {
+  vector<size_t> next( shards.size(), 0 );
+
+  for (;;) {
+
+    size_t best = shards.size();
+
+    for ( size_t i=0; i<shards.size(); i++ ) {
+      if ( next[i] < shards[i].fFixes.size() &&
+           ( best == shards.size() ||
+             shards[i].fFixes[next[i]].fKey <
+             shards[best].fFixes[next[best]].fKey ) )
+        best = i;
+    }
+
+    if ( best == shards.size() ) break;		// all written
+
+    const Shard  *shard = &shards[best];
+    const size_t  to = next[best] + 1;
+    const size_t  begin = shard->fFixes[next[best]].fLine;
+    const size_t  end = to < shard->fFixes.size() ? shard->fFixes[to].fLine
+                                                  : shard->fText.size();
+
+    fwrite( shard->fText.data() + begin, 1, end - begin, outfile );
+
+    next[best] = to;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+static bool ShardsInOrder(const vector<Shard> &shards,
+                          unsigned long long *last)
+/*
+ * ABSTRACT:	Are the fixes of all shards, one after the other, in time
+ *		order ? Only then ShardMerge() keeps the order of the file.
+ *		'last' is the key of the previous round's last fix, updated
+ *		for the next one.
+ */
+ {
+  for ( size_t i=0; i<shards.size(); i++ ) {
+    for ( size_t j=0; j<shards[i].fFixes.size(); j++ ) {
+
+      if ( shards[i].fFixes[j].fKey < *last ) return false;
+
+      *last = shards[i].fFixes[j].fKey;
+    }
+  }
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+//
+// run with:
+//  ./nmea-replay -r 1000 Data/navilock.dat
+//  ./nmea-replay -j 8 -o fixes.csv archive.dat
+//
+
+int main(int argc,char** argv)
+ {
+  if ( argc < 2 ) {
+    Usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  // --- read application parameters from the cmd line
+
+  unsigned long repeat = 1;
+  unsigned long jobs = 1;
+  string outfile_name;
+
+  int getopt_status;
+
+  do {
+
+    getopt_status = getopt( argc, argv, "r:j:o:?" );
+
+    if ( getopt_status == EOF ) break;
+
+    switch ( getopt_status ) {
+
+      case 'r': repeat = strtoul( optarg, NULL, 10 );
+        	if ( !repeat ) repeat = 1;
+        	break;
+
+      case 'j': jobs = strtoul( optarg, NULL, 10 );
+        	if ( !jobs ) jobs = sysconf( _SC_NPROCESSORS_ONLN );
+        	if ( jobs < 1 ) jobs = 1;
+        	break;
+
+      case 'o': outfile_name = optarg;
+        	break;
+
+      case '?': Usage( argv[0] );
+        	exit( EXIT_FAILURE );
+        	break;
+
+      default: printf ( "Encountered unknown option: %d,%c\n",
+	       getopt_status, getopt_status );
+    }
+
+  } while ( getopt_status != EOF );
+
+  if ( optind >= argc ) {
+    Usage( argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  FILE * outfile = NULL;
+
+  if ( !outfile_name.empty() ) {
+
+    outfile = fopen( outfile_name.c_str(), "w" );
+
+    if ( !outfile ) {
+      cerr << argv[0] << ": could not open fix output file!" << endl;
+      exit( EXIT_FAILURE );
+    }
+
+    fprintf( outfile, "# date,time_ms,lat_1e-7deg,lon_1e-7deg,alt_cm,"
+                      "speed_0.1,course_0.01deg,sats,hdop_0.1,valid\n" );
+  }
+
+  vector<Shard> shards( jobs );
+  vector<pthread_t> threads( jobs );
+
+  ReplayStats stats;
+
+  memset( &stats, 0, sizeof(stats) );
+
+  double elapsed = 0;
+
+  for ( int arg = optind; arg < argc; arg++ ) {
+
+    int fd = open( argv[arg], O_RDONLY );
+
+    if ( fd < 0 ) {
+      cerr << argv[0] << ": could not open NMEA data file "
+           << argv[arg] << ": " << strerror( errno ) << endl;
+      exit( EXIT_FAILURE );
+    }
+
+    struct stat st;
+
+    if ( fstat( fd, &st ) < 0 ) {
+      cerr << argv[0] << ": could not stat " << argv[arg] << ": "
+           << strerror( errno ) << endl;
+      exit( EXIT_FAILURE );
+    }
+
+    if ( st.st_size == 0 ) {			// nothing to map
+      close( fd );
+      continue;
+    }
+
+    // map the file, the parser works directly on the page cache
+    //
+    const size_t len = st.st_size;
+    void *map = mmap( NULL, len, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+    close( fd );
+
+    if ( map == MAP_FAILED ) {
+      cerr << argv[0] << ": could not map " << argv[arg] << ": "
+           << strerror( errno ) << endl;
+      exit( EXIT_FAILURE );
+    }
+
+    madvise( map, len, MADV_SEQUENTIAL );
+
+    const double t0 = Now();
+
+    bool warned = false;
+
+    for ( unsigned long r = 0; r < repeat; r++ ) {
+
+      unsigned long long last = 0;
+
+      for ( size_t from = 0; from < len; ) {	// round by round
+
+        from = ShardSplit( shards, (const char *)map, len, from,
+                           outfile != NULL );
+
+        if ( jobs == 1 )
+          ShardRun( &shards[0] );
+        else {
+          for ( size_t i=0; i<jobs; i++ ) {
+            if ( pthread_create( &threads[i], NULL, ShardRun, &shards[i] ) ) {
+              cerr << argv[0] << ": could not start thread" << endl;
+              exit( EXIT_FAILURE );
+            }
+          }
+
+          for ( size_t i=0; i<jobs; i++ )
+            pthread_join( threads[i], NULL );
+        }
+
+        if ( outfile ) {
+
+          if ( jobs > 1 && !warned && !ShardsInOrder( shards, &last ) ) {
+            cerr << argv[0] << ": warning: " << argv[arg] << " is not in "
+                 << "time order, fixes are not written as with -j 1" << endl;
+            warned = true;
+          }
+
+          ShardMerge( shards, outfile );
+        }
+
+        for ( size_t i=0; i<jobs; i++ ) {
+          stats.fBytes     += shards[i].fStats.fBytes;
+          stats.fEpochs    += shards[i].fStats.fEpochs;
+          stats.fRejected  += shards[i].fStats.fRejected;
+          stats.fFixes     += shards[i].fStats.fFixes;
+        }
+      }
+    }
+
+    elapsed += Now() - t0;
+
+    munmap( map, len );
+  }
+
+  if ( outfile )
+    fclose( outfile );
+
+  // --- the report, one 'key: value' pair per line
+
+  if ( elapsed <= 0 ) elapsed = 1e-9;
+
+  printf( "threads: %lu\n", jobs );
+  printf( "bytes: %llu\n", stats.fBytes );
+  printf( "epochs: %llu\n", stats.fEpochs );
+  printf( "rejected: %llu\n", stats.fRejected );
+  printf( "fixes: %llu\n", stats.fFixes );
+  printf( "seconds: %.6f\n", elapsed );
+  printf( "epochs/sec: %.0f\n", stats.fEpochs / elapsed );
+  printf( "bytes/sec: %.0f\n", stats.fBytes / elapsed );
+  printf( "fixes/sec: %.0f\n", stats.fFixes / elapsed );
+
+  exit(EXIT_SUCCESS);
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -0,0 +1,142 @@
+/*
+ * File   : testSerialRing.c
+ *
+ * Purpose: Host test of the USART byte ring (SerialRing.h)
+ *
+ * $Id$
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** @file testSerialRing.c
+  * Checks the ring used by Serial.c on the host: the wrap-around of the
+  * free running counters at the power-of-two mask, a full ring, the overrun
+  * counter and draining all pending bytes. Exits with EXIT_FAILURE on the
+  * first check failing.
+  * @author
+  */
+
+#include "SerialRing.h"
+
+static unsigned int gChecks;			// checks passed so far
+
+/** Stop with a message if '_cond' does not hold. */
+#define CHECK(_cond) \
+  { if ( !(_cond) ) { \
+      fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+               #_cond ); \
+      exit( EXIT_FAILURE ); \
+    } \
+    gChecks++; }
+
+/* ------------------------------------------------------------------------- */
+
+static void TestWrapAround(SerialRing_t *ring)
+/*
+ * ABSTRACT:	Put and get bursts of different lengths, so head and tail
+ *		pass the end of the buffer and the 8 bit counters wrap at
+ *		different positions. The bytes come out in order.
+ */
+ {
+  unsigned char put = 0, get = 0;
+
+  SerialRingInit( ring );
+
+  for ( unsigned int round = 0; round < 1000; round++ ) {
+
+    const unsigned int burst = round % SERIAL_RING_SIZE + 1;
+
+    for ( unsigned int i = 0; i < burst; i++ )
+      CHECK( SerialRingPut( ring, put++ ) == 1 );
+
+    CHECK( SerialRingCount( ring ) == burst );
+
+    for ( unsigned int i = 0; i < burst; i++ )
+      CHECK( SerialRingGet( ring ) == get++ );
+
+    CHECK( SerialRingCount( ring ) == 0 );
+  }
+
+  CHECK( ring->fOverruns == 0 );
+
+} // End TestWrapAround(SerialRing_t *ring)
+
+/* ------------------------------------------------------------------------- */
+
+static void TestFull(SerialRing_t *ring, unsigned char offset)
+/*
+ * ABSTRACT:	Fill the ring starting at 'offset', the byte behind a full
+ *		ring is dropped and counted, the pending ones are kept.
+ */
+ {
+  SerialRingInit( ring );
+
+  for ( unsigned int i = 0; i < offset; i++ ) {	// move head and tail
+    SerialRingPut( ring, 0 );
+    SerialRingGet( ring );
+  }
+
+  for ( unsigned int i = 0; i < SERIAL_RING_SIZE; i++ )
+    CHECK( SerialRingPut( ring, (unsigned char)i ) == 1 );
+
+  CHECK( SerialRingCount( ring ) == SERIAL_RING_SIZE );
+
+  // --- overruns: dropped, counted, nothing overwritten
+
+  for ( unsigned int i = 1; i <= 5; i++ ) {
+    CHECK( SerialRingPut( ring, 0xff ) == 0 );
+    CHECK( ring->fOverruns == i );
+    CHECK( SerialRingCount( ring ) == SERIAL_RING_SIZE );
+  }
+
+  // --- one byte taken, one fits again
+
+  CHECK( SerialRingGet( ring ) == 0 );
+  CHECK( SerialRingPut( ring, SERIAL_RING_SIZE ) == 1 );
+  CHECK( SerialRingPut( ring, 0xff ) == 0 );
+  CHECK( ring->fOverruns == 6 );
+
+  // --- drain everything pending
+
+  unsigned int expect = 1;
+
+  while ( SerialRingCount( ring ) )
+    CHECK( SerialRingGet( ring ) == (unsigned char)expect++ );
+
+  CHECK( expect == SERIAL_RING_SIZE + 1 );
+  CHECK( ring->fHead == ring->fTail );
+  CHECK( ring->fOverruns == 6 );
+
+} // End TestFull(SerialRing_t *ring, unsigned char offset)
+
+/* ------------------------------------------------------------------------- */
+
+//
+// run with:
+//  ./testSerialRing
+//
+
+int main(void)
+ {
+  static SerialRing_t ring;
+
+  TestWrapAround( &ring );
+
+  // full ring at the start of the buffer, in its middle and with the
+  // counters wrapping while it is full
+  //
+  TestFull( &ring, 0 );
+  TestFull( &ring, SERIAL_RING_SIZE / 2 + 3 );
+  TestFull( &ring, 255 - SERIAL_RING_SIZE / 2 );
+
+  printf( "SerialRing (%d bytes): %u checks passed\n", SERIAL_RING_SIZE,
+          gChecks );
+
+  exit(EXIT_SUCCESS);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------------------------------------------------- */